@@ -0,0 +1,209 @@
+/********************************************************************\
+ * This program is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as   *
+ * published by the Free Software Foundation; either version 2 of   *
+ * the License, or (at your option) any later version.              *
+ *                                                                  *
+ * This program is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of   *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the    *
+ * GNU General Public License for more details.                     *
+ *                                                                  *
+ * You should have received a copy of the GNU General Public License*
+ * along with this program; if not, contact:                        *
+ *                                                                  *
+ * Free Software Foundation           Voice:  +1-617-542-5942       *
+ * 59 Temple Place - Suite 330        Fax:    +1-617-542-2652       *
+ * Boston, MA  02111-1307,  USA       gnu@gnu.org                   *
+ *                                                                  *
+\********************************************************************/
+
+/** @file config_bench.c
+    @author Copyright (C) 2025 LYC <365256281@qq.com>
+*/
+
+// Compares the device config in one CRC'd blob (configstore.c) against the
+// per-key NVS layout it replaced: NVS operations and microseconds per load
+// and save, on the host NVS shim (one file per key under a temp directory).
+//
+// NVS calls made by configstore.c are counted through the linker's --wrap.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "platform.h"
+#include "tcpmux.h"
+#include "login.h"
+#include "configstore.h"
+
+#define BENCH_ITERATIONS	2000
+
+static unsigned long g_nvs_ops;
+
+int __real_plat_nvs_get_blob(const char *ns, const char *key, void *buf, size_t *len);
+int __real_plat_nvs_set_blob(const char *ns, const char *key, const void *buf, size_t len);
+
+int __wrap_plat_nvs_get_blob(const char *ns, const char *key, void *buf, size_t *len) {
+    g_nvs_ops++;
+    return __real_plat_nvs_get_blob(ns, key, buf, len);
+}
+
+int __wrap_plat_nvs_set_blob(const char *ns, const char *key, const void *buf, size_t len) {
+    g_nvs_ops++;
+    return __real_plat_nvs_set_blob(ns, key, buf, len);
+}
+
+/* ---- the per-key layout config.c used before, one NVS entry per field ---- */
+
+#define KEY_STR(k, f)	{ k, offsetof(device_config_t, f), sizeof(((device_config_t *)0)->f), 0 }
+#define KEY_U16(k, f)	{ k, offsetof(device_config_t, f), sizeof(uint16_t), 1 }
+#define KEY_U32(k, f)	{ k, offsetof(device_config_t, f), sizeof(uint32_t), 1 }
+
+static const struct {
+    const char *key;
+    size_t      offset;
+    size_t      size;
+    int         fixed;	// integer, stored at its size rather than as a string
+} g_keys[] = {
+    KEY_U32("version", config_version),
+    KEY_STR("wifi_ssid", wifi_ssid),
+    KEY_STR("wifi_password", wifi_password),
+    KEY_STR("wifi_enc", wifi_encryption),
+    KEY_STR("frp_srv", frp_server),
+    KEY_U16("frp_port", frp_port),
+    KEY_STR("frp_tok", frp_token),
+    KEY_STR("prx_name", proxy_name),
+    KEY_STR("prx_type", proxy_type),
+    KEY_STR("loc_ip", local_ip),
+    KEY_U16("loc_port", local_port),
+    KEY_U16("rmt_port", remote_port),
+    KEY_U16("hb_itvl", heartbeat_interval),
+    KEY_U16("hb_to", heartbeat_timeout),
+};
+
+#define KEY_COUNT	(sizeof(g_keys) / sizeof(g_keys[0]))
+
+static int per_key_save(const device_config_t *cfg) {
+    for (int i = 0; i < KEY_COUNT; i++) {
+        const char *field = (const char *)cfg + g_keys[i].offset;
+        size_t len = g_keys[i].fixed ? g_keys[i].size : strlen(field) + 1;
+        if (_SUCCESS != plat_nvs_set_blob(CONFIG_NVS_NS, g_keys[i].key, field, len)) {
+            return _FAIL;
+        }
+    }
+    return _SUCCESS;
+}
+
+static int per_key_load(device_config_t *cfg) {
+    for (int i = 0; i < KEY_COUNT; i++) {
+        size_t len = g_keys[i].size;
+        if (_SUCCESS != plat_nvs_get_blob(CONFIG_NVS_NS, g_keys[i].key, (char *)cfg + g_keys[i].offset, &len)) {
+            return _FAIL;   // Any missing key aborted the whole load
+        }
+    }
+    return _SUCCESS;
+}
+
+/* ---- one case per operation and layout ---- */
+
+typedef enum bench_case {
+    SAVE_PER_KEY, SAVE_BLOB,
+    LOAD_PER_KEY, LOAD_BLOB,
+    BENCH_CASES
+} bench_case_t;
+
+static const char *g_names[BENCH_CASES] = {
+    "save  per-key", "save  blob",
+    "load  per-key", "load  blob",
+};
+
+static const device_config_t g_config = {
+    .wifi_ssid = "OpenWrt",
+    .wifi_password = "diagnosis",
+    .wifi_encryption = "WPA2",
+    .frp_server = "192.168.1.100",
+    .frp_port = 7000,
+    .frp_token = "52010",
+    .proxy_name = "ssh-ubuntu",
+    .proxy_type = "tcp",
+    .local_ip = "127.0.0.1",
+    .local_port = 22,
+    .remote_port = 7005,
+    .heartbeat_interval = 30,
+    .heartbeat_timeout = 90,
+    .config_version = 1
+};
+
+/**
+ * Run one load or save
+ * @return _SUCCESS, or _FAIL if it failed or loaded something else than was saved
+ */
+static int run_case(bench_case_t c) {
+    device_config_t cfg = { .config_version = g_config.config_version };
+
+    switch (c) {
+    case SAVE_PER_KEY: return per_key_save(&g_config);
+    case SAVE_BLOB:    return config_store_save(&g_config);
+    case LOAD_PER_KEY:
+        if (_SUCCESS != per_key_load(&cfg)) {
+            return _FAIL;
+        }
+        break;
+    case LOAD_BLOB:
+        if (CONFIG_FROM_PRIMARY != config_store_load(&cfg, NULL)) {
+            return _FAIL;
+        }
+        break;
+    default:
+        return _FAIL;
+    }
+    return 0 == strcmp(cfg.frp_server, g_config.frp_server) && cfg.remote_port == g_config.remote_port ?
+           _SUCCESS : _FAIL;
+}
+
+static void remove_key(const char *dir, const char *key) {
+    char path[256];
+
+    snprintf(path, sizeof(path), "%s/%s.%s.bin", dir, CONFIG_NVS_NS, key);
+    unlink(path);
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = argc > 1 ? atoi(argv[1]) : BENCH_ITERATIONS;
+    char dir[] = "/tmp/config_bench.XXXXXX";
+    int ret = EXIT_SUCCESS;
+
+    if (NULL == mkdtemp(dir)) {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+    setenv("FRPC_NVS_DIR", dir, 1);
+
+    printf("%-16s %10s %10s\n", "operation", "nvs ops", "us/op");
+    for (int c = 0; c < BENCH_CASES; c++) {
+        if (_SUCCESS != run_case(c)) {  // Warm up, and saves what the loads read
+            fprintf(stderr, "%s failed\n", g_names[c]);
+            ret = EXIT_FAILURE;
+            break;
+        }
+
+        unsigned long ops = g_nvs_ops;
+        int64_t start = plat_now_us();
+        for (int i = 0; i < iterations; i++) {
+            run_case(c);
+        }
+        int64_t elapsed = plat_now_us() - start;
+        ops = g_nvs_ops - ops;
+
+        printf("%-16s %10.1f %10.3f\n", g_names[c], (double)ops / iterations, (double)elapsed / iterations);
+    }
+
+    for (int i = 0; i < KEY_COUNT; i++) {
+        remove_key(dir, g_keys[i].key);
+    }
+    remove_key(dir, CONFIG_NVS_PRIMARY);
+    remove_key(dir, CONFIG_NVS_BACKUP);
+    rmdir(dir);
+    return ret;
+}
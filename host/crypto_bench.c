@@ -0,0 +1,201 @@
+/********************************************************************\
+ * This program is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as   *
+ * published by the Free Software Foundation; either version 2 of   *
+ * the License, or (at your option) any later version.              *
+ *                                                                  *
+ * This program is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of   *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the    *
+ * GNU General Public License for more details.                     *
+ *                                                                  *
+ * You should have received a copy of the GNU General Public License*
+ * along with this program; if not, contact:                        *
+ *                                                                  *
+ * Free Software Foundation           Voice:  +1-617-542-5942       *
+ * 59 Temple Place - Suite 330        Fax:    +1-617-542-2652       *
+ * Boston, MA  02111-1307,  USA       gnu@gnu.org                   *
+ *                                                                  *
+\********************************************************************/
+
+/** @file crypto_bench.c
+    @author Copyright (C) 2025 LYC <365256281@qq.com>
+*/
+
+// Compares decrypting control frames in place with the streaming CFB API
+// (my_aes_decrypt_stream) against the path it replaced: calloc a plaintext
+// buffer per frame, mbedtls_cipher_update() plus mbedtls_cipher_finish(),
+// free. Bytes per second for several frame sizes, on mbedTLS under Linux.
+//
+// Both paths decrypt the same ciphertext, produced by my_aes_encrypt_stream,
+// and their output is checked against the plaintext before timing. Odd
+// frame sizes, which leave a partial AES block between calls, are checked
+// for both directions of the streaming API as well.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mbedtls/cipher.h>
+#include "platform.h"
+#include "crypto.h"
+
+#define BENCH_BYTES		(16 * 1024 * 1024)	// Decrypted per case
+#define STREAM_SIZE		(64 * 1024)			// Ciphertext replayed until BENCH_BYTES
+
+static const uint8_t g_iv[AES_128_IV_SIZE] = "frpc-bench-iv-0";
+static const char *g_token = "52010";
+static const size_t g_frame_sizes[] = { 32, 128, 512, 2048 };
+static const size_t g_odd_sizes[] = { 1, 15, 17, 137 };      // Checked only, not timed
+
+#define FRAME_SIZES	(sizeof(g_frame_sizes) / sizeof(g_frame_sizes[0]))
+#define ODD_SIZES	(sizeof(g_odd_sizes) / sizeof(g_odd_sizes[0]))
+
+static uint8_t g_plain[STREAM_SIZE];
+static uint8_t g_cipher[STREAM_SIZE];
+static uint8_t g_rx[STREAM_SIZE];
+
+/* ---- the copying decrypt process_data() used before ---- */
+
+static mbedtls_cipher_context_t g_old_ctx;
+
+static int old_init(const uint8_t *key) {
+    mbedtls_cipher_init(&g_old_ctx);
+    if (0 != mbedtls_cipher_setup(&g_old_ctx, mbedtls_cipher_info_from_type(MBEDTLS_CIPHER_AES_128_CFB128)) ||
+        0 != mbedtls_cipher_setkey(&g_old_ctx, key, 128, MBEDTLS_DECRYPT)) {
+        return -1;
+    }
+    return 0;
+}
+
+static int old_set_iv(void) {
+    mbedtls_cipher_reset(&g_old_ctx);
+    return mbedtls_cipher_set_iv(&g_old_ctx, g_iv, AES_128_IV_SIZE);
+}
+
+static int old_decrypt(const uint8_t *ciphertext, size_t ct_len, uint8_t *out) {
+    size_t pt_len, finish_olen;
+    uint8_t *decrypted = calloc(1, ct_len + 1);
+    int ret;
+
+    if (NULL == decrypted) {
+        return -1;
+    }
+    ret = mbedtls_cipher_update(&g_old_ctx, ciphertext, ct_len, decrypted, &pt_len);
+    if (0 == ret) {
+        ret = mbedtls_cipher_finish(&g_old_ctx, decrypted + pt_len, &finish_olen);
+    }
+    if (out) {
+        memcpy(out, decrypted, ct_len);
+    }
+    free(decrypted);
+    return ret;
+}
+
+/* ---- one pass over the ciphertext, frame by frame ---- */
+
+/**
+ * Decrypt STREAM_SIZE bytes in frames of frame_size
+ * The old path decrypts from g_cipher into a fresh buffer; the streaming
+ * path works in place on g_rx, as process_data() does on g_RxBuffer.
+ * @param check Leave the plaintext in g_rx for comparison
+ */
+static int run_pass(int streaming, size_t frame_size, int check) {
+    for (size_t off = 0; off < STREAM_SIZE; off += frame_size) {
+        size_t len = STREAM_SIZE - off < frame_size ? STREAM_SIZE - off : frame_size;
+
+        if (streaming) {
+            if (check) {
+                memcpy(g_rx + off, g_cipher + off, len);
+            }
+            if (0 != my_aes_decrypt_stream(g_rx + off, len)) {
+                return -1;
+            }
+        } else if (0 != old_decrypt(g_cipher + off, len, check ? g_rx + off : NULL)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int restart(int streaming) {
+    if (streaming) {
+        return NULL == init_decoder(g_iv) ? -1 : 0;
+    }
+    return old_set_iv();
+}
+
+/**
+ * Check both decrypt paths, and the streaming encrypt, for one frame size
+ * @return 0 if all of them reproduce the reference stream
+ */
+static int check_frames(size_t frame_size) {
+    for (int streaming = 0; streaming < 2; streaming++) {
+        memset(g_rx, 0, sizeof(g_rx));
+        if (0 != restart(streaming) || 0 != run_pass(streaming, frame_size, 1) ||
+            0 != memcmp(g_rx, g_plain, STREAM_SIZE)) {
+            fprintf(stderr, "%s decrypt of %zu byte frames is wrong\n",
+                    streaming ? "streaming" : "copying", frame_size);
+            return -1;
+        }
+    }
+
+    memcpy(g_rx, g_plain, STREAM_SIZE);
+    init_encoder(g_iv);
+    for (size_t off = 0; off < STREAM_SIZE; off += frame_size) {
+        size_t len = STREAM_SIZE - off < frame_size ? STREAM_SIZE - off : frame_size;
+        if (0 != my_aes_encrypt_stream(g_rx + off, len)) {
+            break;
+        }
+    }
+    if (0 != memcmp(g_rx, g_cipher, STREAM_SIZE)) {
+        fprintf(stderr, "streaming encrypt of %zu byte frames is wrong\n", frame_size);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    long total = argc > 1 ? atol(argv[1]) : BENCH_BYTES;
+    int passes = total / STREAM_SIZE > 0 ? total / STREAM_SIZE : 1;
+    struct frp_coder *coder;
+
+    for (int i = 0; i < STREAM_SIZE; i++) {
+        g_plain[i] = (uint8_t)(i * 7 + (i >> 8));
+    }
+    if (0 != crypto_init_key(g_token) || NULL == (coder = init_encoder(g_iv))) {
+        fprintf(stderr, "key setup failed\n");
+        return EXIT_FAILURE;
+    }
+    memcpy(g_cipher, g_plain, STREAM_SIZE);
+    my_aes_encrypt_stream(g_cipher, STREAM_SIZE);
+    if (0 != old_init(coder->key)) {
+        fprintf(stderr, "cipher setup failed\n");
+        return EXIT_FAILURE;
+    }
+    for (size_t f = 0; f < ODD_SIZES; f++) {
+        if (0 != check_frames(g_odd_sizes[f])) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("%-10s %-10s %12s\n", "frame", "path", "MB/s");
+    for (size_t f = 0; f < FRAME_SIZES; f++) {
+        if (0 != check_frames(g_frame_sizes[f])) {
+            return EXIT_FAILURE;
+        }
+        for (int streaming = 0; streaming < 2; streaming++) {
+            int64_t start = plat_now_us();
+            for (int p = 0; p < passes; p++) {
+                restart(streaming);  // One session per pass, as a reconnect would
+                run_pass(streaming, g_frame_sizes[f], 0);
+            }
+            int64_t elapsed = plat_now_us() - start;
+
+            printf("%-10zu %-10s %12.1f\n", g_frame_sizes[f], streaming ? "in place" : "copying",
+                   (double)passes * STREAM_SIZE / (elapsed > 0 ? elapsed : 1));
+        }
+    }
+
+    mbedtls_cipher_free(&g_old_ctx);
+    return EXIT_SUCCESS;
+}
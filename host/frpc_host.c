@@ -0,0 +1,67 @@
+/********************************************************************\
+ * This program is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as   *
+ * published by the Free Software Foundation; either version 2 of   *
+ * the License, or (at your option) any later version.              *
+ *                                                                  *
+ * This program is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of   *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the    *
+ * GNU General Public License for more details.                     *
+ *                                                                  *
+ * You should have received a copy of the GNU General Public License*
+ * along with this program; if not, contact:                        *
+ *                                                                  *
+ * Free Software Foundation           Voice:  +1-617-542-5942       *
+ * 59 Temple Place - Suite 330        Fax:    +1-617-542-2652       *
+ * Boston, MA  02111-1307,  USA       gnu@gnu.org                   *
+ *                                                                  *
+\********************************************************************/
+
+/** @file frpc_host.c
+    @author Copyright (C) 2025 LYC <365256281@qq.com>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "platform.h"
+#include "config.h"
+#include "control.h"
+#include "boottrace.h"
+#include "memplan.h"
+
+static const char *TAG = "host";
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-s server] [-p port] [-t token] [-n proxy_name]\n"
+                    "          [-l local_ip] [-L local_port] [-r remote_port]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * Native frpc: same protocol core as the firmware, configured from argv
+ */
+int main(int argc, char *argv[]) {
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:p:t:n:l:L:r:h")) != -1) {
+        switch (opt) {
+        case 's': snprintf(g_device_config.frp_server, sizeof(g_device_config.frp_server), "%s", optarg); break;
+        case 'p': g_device_config.frp_port = atoi(optarg); break;
+        case 't': snprintf(g_device_config.frp_token, sizeof(g_device_config.frp_token), "%s", optarg); break;
+        case 'n': snprintf(g_device_config.proxy_name, sizeof(g_device_config.proxy_name), "%s", optarg); break;
+        case 'l': snprintf(g_device_config.local_ip, sizeof(g_device_config.local_ip), "%s", optarg); break;
+        case 'L': g_device_config.local_port = atoi(optarg); break;
+        case 'r': g_device_config.remote_port = atoi(optarg); break;
+        default: usage(argv[0]);
+        }
+    }
+
+    ESP_LOGI(TAG, "FRP Server: %s:%d", g_device_config.frp_server, g_device_config.frp_port);
+    mem_plan_init(RUN_MODE_TUNNEL);
+    initialize();
+    boot_mark(BOOT_INIT);
+    connect_to_server();
+    return 0;
+}
@@ -0,0 +1,59 @@
+/********************************************************************\
+ * This program is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as   *
+ * published by the Free Software Foundation; either version 2 of   *
+ * the License, or (at your option) any later version.              *
+ *                                                                  *
+ * This program is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of   *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the    *
+ * GNU General Public License for more details.                     *
+ *                                                                  *
+ * You should have received a copy of the GNU General Public License*
+ * along with this program; if not, contact:                        *
+ *                                                                  *
+ * Free Software Foundation           Voice:  +1-617-542-5942       *
+ * 59 Temple Place - Suite 330        Fax:    +1-617-542-2652       *
+ * Boston, MA  02111-1307,  USA       gnu@gnu.org                   *
+ *                                                                  *
+\********************************************************************/
+
+/** @file host_device.c
+    @author Copyright (C) 2025 LYC <365256281@qq.com>
+*/
+
+#include "platform.h"
+#include "config.h"
+#include "control.h"
+#include "timer.h"
+
+static const char *TAG = "host";
+
+// Device-side globals the protocol core links against
+device_config_t g_device_config = {
+    .frp_server = "127.0.0.1",
+    .frp_port = 7000,
+    .frp_token = "52010",
+    .proxy_name = "host-frpc",
+    .proxy_type = "tcp",
+    .local_ip = "127.0.0.1",
+    .local_port = 0,
+    .remote_port = 7005,
+    .heartbeat_interval = 30,
+    .heartbeat_timeout = 90,
+    .config_version = 1
+};
+bool config_mode = false;
+
+void set_frpc_connection_connected(void) {
+    ESP_LOGI(TAG, "connection established");
+}
+
+void set_frpc_connection_lost(void) {
+    ESP_LOGI(TAG, "connection lost");
+}
+
+void set_frpc_connection_disconnected(void) {
+    ESP_LOGI(TAG, "disconnected");
+}
+
@@ -0,0 +1,242 @@
+/********************************************************************\
+ * This program is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as   *
+ * published by the Free Software Foundation; either version 2 of   *
+ * the License, or (at your option) any later version.              *
+ *                                                                  *
+ * This program is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of   *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the    *
+ * GNU General Public License for more details.                     *
+ *                                                                  *
+ * You should have received a copy of the GNU General Public License*
+ * along with this program; if not, contact:                        *
+ *                                                                  *
+ * Free Software Foundation           Voice:  +1-617-542-5942       *
+ * 59 Temple Place - Suite 330        Fax:    +1-617-542-2652       *
+ * Boston, MA  02111-1307,  USA       gnu@gnu.org                   *
+ *                                                                  *
+\********************************************************************/
+
+/** @file json_bench.c
+    @author Copyright (C) 2025 LYC <365256281@qq.com>
+*/
+
+// Compares the control message JSON in msg.c against the cJSON DOM code it
+// replaced: heap allocations and microseconds per message.
+//
+// Allocations made by this program and libfrpc.a are counted through the
+// linker's --wrap, those made inside libcjson through cJSON_InitHooks().
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "platform.h"
+#include "cJSON.h"
+#include "login.h"
+#include "msg.h"
+#include "sntp.h"
+
+#define BENCH_ITERATIONS	20000
+
+extern login_t *g_pLogin;
+extern MainConfig_t *g_pMainConf;
+
+static unsigned long g_allocs;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+char *__real_strdup(const char *s);
+
+void *__wrap_malloc(size_t size) { g_allocs++; return __real_malloc(size); }
+void *__wrap_calloc(size_t n, size_t size) { g_allocs++; return __real_calloc(n, size); }
+void *__wrap_realloc(void *ptr, size_t size) { g_allocs++; return __real_realloc(ptr, size); }
+char *__wrap_strdup(const char *s) { g_allocs++; return __real_strdup(s); }
+
+static void *cjson_malloc(size_t size) {
+    g_allocs++;
+    return __real_malloc(size);
+}
+
+static const char *LOGIN_RESP = "{\"version\":\"0.43.0\",\"hostname\":\"\",\"run_id\":\"A1B2C3D4E5F6\","
+                                "\"server_udp_port\":0,\"error\":\"\"}";
+static const char *NEW_PROXY_RESP = "{\"proxy_name\":\"host-frpc\",\"remote_addr\":\":7005\",\"error\":\"\"}";
+
+static ProxyService_t g_ps = {
+    .proxy_name = "host-frpc",
+    .proxy_type = "tcp",
+    .local_ip = "127.0.0.1",
+    .remote_port = 7005,
+    .local_port = 22,
+};
+
+/* ---- the cJSON implementations msg.c used before ---- */
+
+static uint32_t cjson_login_request_marshal(char **msg) {
+    uint32_t nret = 0;
+    char buf[32];
+    char seed[128];
+    char *auth_key = malloc(33);
+
+    time_t now = 0;
+    clock_get_time(&now);
+    g_pLogin->timestamp = (int)now;
+    snprintf(seed, sizeof(seed), "%s%d", g_pMainConf->auth_token, g_pLogin->timestamp);
+    calc_md5(seed, strlen(seed), auth_key);
+    char *privilege_key = strdup(auth_key);
+
+    cJSON *j_login_req = cJSON_CreateObject();
+    cJSON_AddStringToObject(j_login_req, "version", SAFE_JSON_STRING(g_pLogin->version));
+    cJSON_AddStringToObject(j_login_req, "hostname", SAFE_JSON_STRING(g_pLogin->hostname));
+    cJSON_AddStringToObject(j_login_req, "os", SAFE_JSON_STRING(g_pLogin->os));
+    cJSON_AddStringToObject(j_login_req, "arch", SAFE_JSON_STRING(g_pLogin->arch));
+    cJSON_AddStringToObject(j_login_req, "user", SAFE_JSON_STRING(g_pLogin->user));
+    cJSON_AddStringToObject(j_login_req, "privilege_key", privilege_key);
+    sprintf(buf, "%d", g_pLogin->timestamp);
+    cJSON_AddRawToObject(j_login_req, "timestamp", buf);
+    cJSON_AddStringToObject(j_login_req, "run_id", SAFE_JSON_STRING(g_pLogin->run_id));
+    sprintf(buf, "%d", g_pLogin->pool_count);
+    cJSON_AddRawToObject(j_login_req, "pool_count", buf);
+    cJSON_AddNullToObject(j_login_req, "metas");
+
+    char *tmp = cJSON_PrintUnformatted(j_login_req);
+    nret = strlen(tmp);
+    *msg = strdup(tmp);
+    cJSON_free(tmp);
+    cJSON_Delete(j_login_req);
+    free(privilege_key);
+    free(auth_key);
+    return nret;
+}
+
+static int cjson_new_proxy_service_marshal(const struct proxy_service *np_req, char **msg) {
+    char buffer[32];
+    cJSON *j_np_req = cJSON_CreateObject();
+
+    cJSON_AddStringToObject(j_np_req, "proxy_name", np_req->proxy_name);
+    cJSON_AddStringToObject(j_np_req, "proxy_type", np_req->proxy_type);
+    cJSON_AddBoolToObject(j_np_req, "use_encryption", np_req->use_encryption);
+    cJSON_AddBoolToObject(j_np_req, "use_compression", np_req->use_compression);
+    snprintf(buffer, sizeof(buffer), "%d", np_req->remote_port);
+    cJSON_AddRawToObject(j_np_req, "remote_port", buffer);
+
+    char *tmp = cJSON_Print(j_np_req);
+    int nret = strlen(tmp);
+    *msg = malloc(nret + 1);
+    strcpy(*msg, tmp);
+    cJSON_free(tmp);
+    cJSON_Delete(j_np_req);
+    return nret;
+}
+
+static int cjson_new_work_conn_marshal(const struct work_conn *work_c, char **msg) {
+    cJSON *j_new_work_conn = cJSON_CreateObject();
+
+    cJSON_AddStringToObject(j_new_work_conn, "run_id", work_c->run_id);
+    char *tmp = cJSON_PrintUnformatted(j_new_work_conn);
+    int nret = strlen(tmp);
+    *msg = strdup(tmp);
+    cJSON_Delete(j_new_work_conn);
+    cJSON_free(tmp);
+    return nret;
+}
+
+static int cjson_login_resp_unmarshal(const char *jres) {
+    cJSON *j_lg_res = cJSON_Parse(jres);
+    char *version = strdup(cJSON_GetObjectItem(j_lg_res, "version")->valuestring);
+    char *run_id = strdup(cJSON_GetObjectItem(j_lg_res, "run_id")->valuestring);
+    int ok = '\0' != run_id[0];
+
+    cJSON_Delete(j_lg_res);
+    free(version);
+    free(run_id);
+    return ok;
+}
+
+static int cjson_new_proxy_resp_unmarshal(const char *jres) {
+    cJSON *j_np_res = cJSON_Parse(jres);
+    cJSON *np_error = cJSON_GetObjectItem(j_np_res, "error");
+    int ok = cJSON_IsString(np_error) && '\0' == np_error->valuestring[0];
+
+    cJSON_Delete(j_np_res);
+    return ok;
+}
+
+/* ---- one case per message and implementation ---- */
+
+typedef enum bench_case {
+    LOGIN_CJSON, LOGIN_MINI,
+    NEW_PROXY_CJSON, NEW_PROXY_MINI,
+    NEW_WORK_CONN_CJSON, NEW_WORK_CONN_MINI,
+    LOGIN_RESP_CJSON, LOGIN_RESP_MINI,
+    NEW_PROXY_RESP_CJSON, NEW_PROXY_RESP_MINI,
+    BENCH_CASES
+} bench_case_t;
+
+static const char *g_names[BENCH_CASES] = {
+    "Login         cJSON", "Login         minijson",
+    "NewProxy      cJSON", "NewProxy      minijson",
+    "NewWorkConn   cJSON", "NewWorkConn   minijson",
+    "LoginResp     cJSON", "LoginResp     minijson",
+    "NewProxyResp  cJSON", "NewProxyResp  minijson",
+};
+
+/**
+ * Encode or decode one message
+ * @return Message length, or non-zero success for decoders
+ */
+static int run_case(bench_case_t c, char *arena, size_t cap) {
+    struct work_conn work_c = { .run_id = g_pLogin->run_id };
+    struct login_resp lres;
+    struct new_proxy_resp npr;
+    char *msg = NULL;
+    int n = 0;
+
+    switch (c) {
+    case LOGIN_CJSON:          n = cjson_login_request_marshal(&msg); break;
+    case LOGIN_MINI:           n = login_request_marshal(arena, cap); break;
+    case NEW_PROXY_CJSON:      n = cjson_new_proxy_service_marshal(&g_ps, &msg); break;
+    case NEW_PROXY_MINI:       n = new_proxy_service_marshal(&g_ps, arena, cap); break;
+    case NEW_WORK_CONN_CJSON:  n = cjson_new_work_conn_marshal(&work_c, &msg); break;
+    case NEW_WORK_CONN_MINI:   n = new_work_conn_marshal(&work_c, arena, cap); break;
+    case LOGIN_RESP_CJSON:     n = cjson_login_resp_unmarshal(LOGIN_RESP); break;
+    case LOGIN_RESP_MINI:      n = _SUCCESS == login_resp_unmarshal(LOGIN_RESP, strlen(LOGIN_RESP), &lres); break;
+    case NEW_PROXY_RESP_CJSON: n = cjson_new_proxy_resp_unmarshal(NEW_PROXY_RESP); break;
+    case NEW_PROXY_RESP_MINI:  n = _SUCCESS == new_proxy_resp_unmarshal(NEW_PROXY_RESP, strlen(NEW_PROXY_RESP), &npr) && !npr.error[0]; break;
+    default: break;
+    }
+    free(msg);
+    return n;
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = argc > 1 ? atoi(argv[1]) : BENCH_ITERATIONS;
+    cJSON_Hooks hooks = { cjson_malloc, free };
+    static char arena[MSG_TX_ARENA_SIZE];
+
+    cJSON_InitHooks(&hooks);
+    init_login();
+    init_main_config();
+
+    printf("%-24s %8s %12s %10s\n", "message", "bytes", "allocs/msg", "us/msg");
+    for (int c = 0; c < BENCH_CASES; c++) {
+        int n = run_case(c, arena, sizeof(arena));  // Warm up, and the size for the table
+        if (0 == n) {
+            fprintf(stderr, "%s failed\n", g_names[c]);
+            return EXIT_FAILURE;
+        }
+
+        unsigned long allocs = g_allocs;
+        int64_t start = plat_now_us();
+        for (int i = 0; i < iterations; i++) {
+            run_case(c, arena, sizeof(arena));
+        }
+        int64_t elapsed = plat_now_us() - start;
+        allocs = g_allocs - allocs;
+
+        printf("%-24s %8d %12.1f %10.3f\n", g_names[c], c < LOGIN_RESP_CJSON ? n : 0,
+               (double)allocs / iterations, (double)elapsed / iterations);
+    }
+    return EXIT_SUCCESS;
+}
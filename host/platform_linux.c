@@ -0,0 +1,185 @@
+/********************************************************************\
+ * This program is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as   *
+ * published by the Free Software Foundation; either version 2 of   *
+ * the License, or (at your option) any later version.              *
+ *                                                                  *
+ * This program is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of   *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the    *
+ * GNU General Public License for more details.                     *
+ *                                                                  *
+ * You should have received a copy of the GNU General Public License*
+ * along with this program; if not, contact:                        *
+ *                                                                  *
+ * Free Software Foundation           Voice:  +1-617-542-5942       *
+ * 59 Temple Place - Suite 330        Fax:    +1-617-542-2652       *
+ * Boston, MA  02111-1307,  USA       gnu@gnu.org                   *
+ *                                                                  *
+\********************************************************************/
+
+/** @file platform_linux.c
+    @author Copyright (C) 2025 LYC <365256281@qq.com>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <mbedtls/version.h>
+#include <mbedtls/md5.h>
+#include "login.h"
+#include "tcpmux.h"
+#include "platform.h"
+
+/**
+ * Log a line to stderr in the ESP_LOGx layout
+ * @param level E, W, I, D or V
+ * @param tag Module tag
+ * @param fmt printf format
+ */
+void plat_log(char level, const char *tag, const char *fmt, ...) {
+    va_list ap;
+
+    fprintf(stderr, "%c (%u) %s: ", level, plat_now_ms(), tag);
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+}
+
+uint32_t plat_now_ms(void) {
+    return (uint32_t)(plat_now_us() / 1000);
+}
+
+/**
+ * Microseconds since the first call, the host's stand-in for boot
+ */
+int64_t plat_now_us(void) {
+    static int64_t start = 0;
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    int64_t now = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    if (0 == start) {
+        start = now - 1;    // Never report 0, callers use it as "unset"
+    }
+    return now - start;
+}
+
+void plat_sleep_ms(uint32_t ms) {
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000 };
+
+    while (nanosleep(&ts, &ts) < 0 && EINTR == errno) {
+    }
+}
+
+uint32_t plat_random(void) {
+    static int seeded = 0;
+
+    if (!seeded) {
+        srandom((unsigned)plat_now_us() ^ (unsigned)getpid());
+        seeded = 1;
+    }
+    return (uint32_t)random();
+}
+
+/**
+ * Free heap is not tracked on the host
+ */
+uint32_t plat_free_heap(void) {
+    return 0;
+}
+
+/**
+ * There is no device to reboot; exit and leave restarting to the caller
+ */
+void plat_restart(void) {
+    ESP_LOGE("platform", "restart requested, exiting");
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * Derive a stable, locally administered MAC from the host name
+ * @param mac Output address
+ * @return _SUCCESS
+ */
+int plat_read_mac(uint8_t mac[6]) {
+    char host[64] = "frpc";
+    uint8_t digest[16];
+
+    gethostname(host, sizeof(host) - 1);
+    plat_md5((const uint8_t *)host, strlen(host), digest);
+    memcpy(mac, digest, 6);
+    mac[0] = (mac[0] & 0xfe) | 0x02;
+    return _SUCCESS;
+}
+
+void plat_md5(const uint8_t *data, size_t len, uint8_t digest[16]) {
+#if MBEDTLS_VERSION_MAJOR >= 3
+    mbedtls_md5(data, len, digest);
+#else
+    mbedtls_md5_ret(data, len, digest);
+#endif
+}
+
+void plat_gpio_set(int pin, int level) {
+    ESP_LOGD("platform", "gpio %d = %d", pin, level);
+}
+
+/**
+ * NVS is emulated with one file per key under $FRPC_NVS_DIR (default ".")
+ */
+static void nvs_path(const char *ns, const char *key, char *path, size_t size) {
+    const char *dir = getenv("FRPC_NVS_DIR");
+
+    snprintf(path, size, "%s/%s.%s.bin", dir ? dir : ".", ns, key);
+}
+
+int plat_nvs_get_blob(const char *ns, const char *key, void *buf, size_t *len) {
+    char path[256];
+
+    nvs_path(ns, key, path, sizeof(path));
+    FILE *fp = fopen(path, "rb");
+    if (NULL == fp) {
+        return _FAIL;
+    }
+    size_t n = fread(buf, 1, *len, fp);
+    int more = fgetc(fp) != EOF;
+    fclose(fp);
+    if (more) {
+        return _FAIL;   // Stored blob is larger than the buffer
+    }
+    *len = n;
+    return _SUCCESS;
+}
+
+int plat_nvs_set_blob(const char *ns, const char *key, const void *buf, size_t len) {
+    char path[256], tmp[260];
+
+    nvs_path(ns, key, path, sizeof(path));
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *fp = fopen(tmp, "wb");
+    if (NULL == fp) {
+        return _FAIL;
+    }
+    int ok = fwrite(buf, 1, len, fp) == len;
+    ok = (0 == fclose(fp)) && ok;
+    if (!ok || rename(tmp, path) < 0) {
+        remove(tmp);
+        return _FAIL;
+    }
+    return _SUCCESS;
+}
+
+/**
+ * No RTC memory on the host, the OS clock is always valid anyway
+ */
+int plat_rtc_load(uint32_t offset, void *buf, size_t len) {
+    return _FAIL;
+}
+
+int plat_rtc_store(uint32_t offset, const void *buf, size_t len) {
+    return _FAIL;
+}
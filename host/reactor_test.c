@@ -0,0 +1,156 @@
+/********************************************************************\
+ * This program is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as   *
+ * published by the Free Software Foundation; either version 2 of   *
+ * the License, or (at your option) any later version.              *
+ *                                                                  *
+ * This program is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of   *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the    *
+ * GNU General Public License for more details.                     *
+ *                                                                  *
+ * You should have received a copy of the GNU General Public License*
+ * along with this program; if not, contact:                        *
+ *                                                                  *
+ * Free Software Foundation           Voice:  +1-617-542-5942       *
+ * 59 Temple Place - Suite 330        Fax:    +1-617-542-2652       *
+ * Boston, MA  02111-1307,  USA       gnu@gnu.org                   *
+ *                                                                  *
+\********************************************************************/
+
+/** @file reactor_test.c
+    @author Copyright (C) 2025 LYC <365256281@qq.com>
+*/
+
+// Checks the reactor timer wheel on a simulated clock: expiry times on
+// either side of a full wheel turn, timers that re-arm from their own
+// callback (one tick, and a whole number of turns), and a timer stopped
+// by another timer's callback in the same slot.
+//
+// plat_now_ms() and plat_sleep_ms() are replaced through the linker's
+// --wrap: with no sockets watched, reactor_run_once() sleeps until the next
+// tick, which here just moves the clock.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "platform.h"
+#include "reactor.h"
+
+#define TEST_FIRE_LIMIT     1000    // callbacks per run_ticks() call before we call it a loop
+
+static uint32_t g_now_ms = 1000;
+static int g_fired_in_run;
+
+uint32_t __wrap_plat_now_ms(void) {
+    return g_now_ms;
+}
+
+void __wrap_plat_sleep_ms(uint32_t ms) {
+    g_now_ms += ms;
+}
+
+typedef struct test_timer {
+    reactor_timer_t     timer;
+    uint32_t            rearm_ms;   // re-armed for this long from its callback, 0 for one-shot
+    uint32_t            fires;
+    uint32_t            last_ms;    // clock at the last expiry
+    reactor_timer_t     *victim;    // stopped from the callback, if set
+} test_timer_t;
+
+static void on_timer(void *arg) {
+    test_timer_t *t = arg;
+
+    t->fires++;
+    t->last_ms = g_now_ms;
+    if (++g_fired_in_run > TEST_FIRE_LIMIT) {
+        fprintf(stderr, "FAIL: timer keeps firing within one tick\n");
+        exit(EXIT_FAILURE);
+    }
+    if (t->victim) {
+        reactor_timer_stop(t->victim);
+    }
+    if (t->rearm_ms) {
+        reactor_timer_start(&t->timer, t->rearm_ms, on_timer, t);
+    }
+}
+
+static void start(test_timer_t *t, uint32_t ms, uint32_t rearm_ms) {
+    t->rearm_ms = rearm_ms;
+    reactor_timer_start(&t->timer, ms, on_timer, t);
+}
+
+/**
+ * Run the reactor until the clock has moved by ticks wheel ticks
+ */
+static void run_ticks(uint32_t ticks) {
+    uint32_t until = g_now_ms + ticks * REACTOR_TICK_MS;
+
+    g_fired_in_run = 0;
+    while ((int32_t)(until - g_now_ms) > 0) {
+        reactor_run_once(until - g_now_ms);
+    }
+}
+
+static int test_expiry() {
+    static const uint32_t ticks[] = { 1, 2, REACTOR_WHEEL_SLOTS - 1, REACTOR_WHEEL_SLOTS,
+                                      REACTOR_WHEEL_SLOTS + 1, 2 * REACTOR_WHEEL_SLOTS + 3 };
+    test_timer_t t[sizeof(ticks) / sizeof(ticks[0])] = { 0 };
+    uint32_t armed_ms = g_now_ms;
+
+    for (size_t i = 0; i < sizeof(ticks) / sizeof(ticks[0]); i++) {
+        start(&t[i], ticks[i] * REACTOR_TICK_MS, 0);
+    }
+    run_ticks(3 * REACTOR_WHEEL_SLOTS);
+    for (size_t i = 0; i < sizeof(ticks) / sizeof(ticks[0]); i++) {
+        if (1 != t[i].fires || t[i].last_ms - armed_ms != ticks[i] * REACTOR_TICK_MS) {
+            fprintf(stderr, "FAIL: %u tick timer fired %u times, after %u ms\n",
+                    ticks[i], t[i].fires, t[i].last_ms - armed_ms);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int test_rearm(uint32_t ticks, uint32_t periods) {
+    test_timer_t t = { 0 };
+    uint32_t armed_ms = g_now_ms;
+
+    start(&t, ticks * REACTOR_TICK_MS, ticks * REACTOR_TICK_MS);
+    run_ticks(ticks * periods);
+    reactor_timer_stop(&t.timer);
+    if (t.fires != periods || t.last_ms - armed_ms != ticks * periods * REACTOR_TICK_MS) {
+        fprintf(stderr, "FAIL: %u tick timer re-armed from its callback fired %u of %u times\n",
+                ticks, t.fires, periods);
+        return -1;
+    }
+    return 0;
+}
+
+static int test_stop_from_callback() {
+    test_timer_t killer = { 0 }, victim = { 0 };
+
+    // Same expiry, so both are in the slot being run; whichever runs first
+    // stops the other.
+    killer.victim = &victim.timer;
+    victim.victim = &killer.timer;
+    start(&killer, 3 * REACTOR_TICK_MS, 0);
+    start(&victim, 3 * REACTOR_TICK_MS, 0);
+    run_ticks(REACTOR_WHEEL_SLOTS + 4);
+    if (1 != killer.fires + victim.fires) {
+        fprintf(stderr, "FAIL: timer stopped from a callback in its slot still fired\n");
+        return -1;
+    }
+    return 0;
+}
+
+int main() {
+    if (test_expiry() < 0 ||
+        test_rearm(1, 20) < 0 ||
+        test_rearm(REACTOR_WHEEL_SLOTS, 3) < 0 ||
+        test_rearm(2 * REACTOR_WHEEL_SLOTS, 2) < 0 ||
+        test_stop_from_callback() < 0) {
+        return EXIT_FAILURE;
+    }
+    printf("PASS: expiry around a wheel turn, re-arm from callbacks, stop from a callback\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,242 @@
+/********************************************************************\
+ * This program is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as   *
+ * published by the Free Software Foundation; either version 2 of   *
+ * the License, or (at your option) any later version.              *
+ *                                                                  *
+ * This program is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of   *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the    *
+ * GNU General Public License for more details.                     *
+ *                                                                  *
+ * You should have received a copy of the GNU General Public License*
+ * along with this program; if not, contact:                        *
+ *                                                                  *
+ * Free Software Foundation           Voice:  +1-617-542-5942       *
+ * 59 Temple Place - Suite 330        Fax:    +1-617-542-2652       *
+ * Boston, MA  02111-1307,  USA       gnu@gnu.org                   *
+ *                                                                  *
+\********************************************************************/
+
+/** @file send_bench.c
+    @author Copyright (C) 2025 LYC <365256281@qq.com>
+*/
+
+// Compares sending a tcp mux DATA frame with one sendmsg() (tmux_stream_writev)
+// against the path it replaced: send() of the 12-byte header, then send() of
+// the payload. Each message is a round trip on a loopback TCP connection:
+// the peer reads the whole frame and answers one byte, as frps answers a
+// control message. Per message: segments on the wire (TCP_INFO segs_out),
+// bytes per segment, send calls and microseconds, with and without Nagle.
+//
+// send calls on the sending socket are counted through the linker's --wrap.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "platform.h"
+#include "tcpmux.h"
+#include "control.h"
+
+#define BENCH_MESSAGES		200
+#define BENCH_PAYLOAD		64
+
+// struct tcp_info as the kernel fills it; glibc's copy stops at tcpi_total_retrans
+struct tcp_info_ext {
+    struct tcp_info base;
+    uint64_t    pacing_rate;
+    uint64_t    max_pacing_rate;
+    uint64_t    bytes_acked;
+    uint64_t    bytes_received;
+    uint32_t    segs_out;
+    uint32_t    segs_in;
+};
+
+static int g_sender = -1;
+static unsigned long g_send_calls;
+
+ssize_t __real_send(int fd, const void *buf, size_t len, int flags);
+ssize_t __real_sendmsg(int fd, const struct msghdr *msg, int flags);
+
+ssize_t __wrap_send(int fd, const void *buf, size_t len, int flags) {
+    if (fd == g_sender) {
+        g_send_calls++;
+    }
+    return __real_send(fd, buf, len, flags);
+}
+
+ssize_t __wrap_sendmsg(int fd, const struct msghdr *msg, int flags) {
+    if (fd == g_sender) {
+        g_send_calls++;
+    }
+    return __real_sendmsg(fd, msg, flags);
+}
+
+/* ---- loopback connection and the answering peer ---- */
+
+typedef struct peer {
+    int         fd;
+    size_t      frame;      // bytes per message, header included
+    int         messages;
+} peer_t;
+
+static void *peer_main(void *arg) {
+    peer_t *peer = arg;
+    char buf[4096];
+
+    for (int m = 0; m < peer->messages; m++) {
+        for (size_t got = 0; got < peer->frame; ) {
+            size_t want = peer->frame - got < sizeof(buf) ? peer->frame - got : sizeof(buf);
+            ssize_t n = recv(peer->fd, buf, want, 0);
+            if (n <= 0) {
+                return NULL;
+            }
+            got += n;
+        }
+        if (send(peer->fd, "k", 1, 0) != 1) {
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+static int loopback_pair(int *sender, int *receiver) {
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t len = sizeof(addr);
+    int lfd = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (lfd < 0 || bind(lfd, (struct sockaddr *)&addr, len) < 0 || listen(lfd, 1) < 0 ||
+        getsockname(lfd, (struct sockaddr *)&addr, &len) < 0) {
+        perror("listen");
+        return -1;
+    }
+    *sender = socket(AF_INET, SOCK_STREAM, 0);
+    if (*sender < 0 || connect(*sender, (struct sockaddr *)&addr, len) < 0) {
+        perror("connect");
+        close(lfd);
+        return -1;
+    }
+    *receiver = accept(lfd, NULL, NULL);
+    close(lfd);
+    return *receiver < 0 ? -1 : 0;
+}
+
+/* ---- the two ways of sending a frame ---- */
+
+static int send_two_calls(int fd, tmux_stream_t *stream, char *payload, uint len) {
+    tcp_mux_header_t hdr;
+
+    tcp_mux_encode(DATA, get_send_flags(stream), stream->id, len, &hdr);
+    if (send(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) || send(fd, payload, len, 0) != (ssize_t)len) {
+        return -1;
+    }
+    return 0;
+}
+
+static int send_one_call(int fd, tmux_stream_t *stream, char *payload, uint len) {
+    struct iovec iov[2];
+
+    iov[1].iov_base = payload;
+    iov[1].iov_len = len;
+    return tmux_stream_writev(fd, iov, 2, stream) == (int)len ? 0 : -1;
+}
+
+typedef struct bench_case {
+    const char *name;
+    int         nodelay;
+    int       (*send_frame)(int fd, tmux_stream_t *stream, char *payload, uint len);
+} bench_case_t;
+
+static const bench_case_t g_cases[] = {
+    { "two sends, nodelay",  1, send_two_calls },
+    { "sendmsg,   nodelay",  1, send_one_call },
+    { "two sends, nagle",    0, send_two_calls },
+    { "sendmsg,   nagle",    0, send_one_call },
+};
+
+#define BENCH_CASES	(sizeof(g_cases) / sizeof(g_cases[0]))
+
+static int segs_out(int fd, uint32_t *segs) {
+    struct tcp_info_ext info;
+    socklen_t len = sizeof(info);
+
+    memset(&info, 0, sizeof(info));
+    if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) < 0 ||
+        len < offsetof(struct tcp_info_ext, segs_out) + sizeof(info.segs_out)) {
+        return -1;  // Kernel older than 4.2
+    }
+    *segs = info.segs_out;
+    return 0;
+}
+
+static int run_case(const bench_case_t *c, int messages, uint payload_len) {
+    static char payload[TMUX_RING_SIZE];
+    peer_t peer = { .frame = sizeof(tcp_mux_header_t) + payload_len, .messages = messages };
+    tmux_stream_t stream;
+    pthread_t thread;
+    uint32_t segs_before, segs_after;
+    unsigned long calls;
+    char ack;
+    int ret = 0;
+
+    if (loopback_pair(&g_sender, &peer.fd) < 0) {
+        return -1;
+    }
+    setsockopt(g_sender, IPPROTO_TCP, TCP_NODELAY, &c->nodelay, sizeof(c->nodelay));
+    memset(payload, 'p', payload_len);
+    tmux_stream_init(&stream, 3);
+    pthread_create(&thread, NULL, peer_main, &peer);
+
+    calls = g_send_calls;
+    if (segs_out(g_sender, &segs_before) < 0) {
+        fprintf(stderr, "TCP_INFO has no segs_out on this kernel\n");
+        ret = -1;
+        messages = 0;
+    }
+    int64_t start = plat_now_us();
+    for (int m = 0; m < messages; m++) {
+        stream.send_window = TMUX_MAX_WINDOW;
+        if (c->send_frame(g_sender, &stream, payload, payload_len) < 0 || recv(g_sender, &ack, 1, 0) != 1) {
+            fprintf(stderr, "%s: message %d failed\n", c->name, m);
+            ret = -1;
+            break;
+        }
+    }
+    int64_t elapsed = plat_now_us() - start;
+    calls = g_send_calls - calls;
+
+    if (0 == ret && 0 == segs_out(g_sender, &segs_after)) {
+        double segs = (double)(segs_after - segs_before) / messages;
+        printf("%-20s %10.2f %10.1f %10.2f %10.1f\n", c->name, segs, peer.frame / segs,
+               (double)calls / messages, (double)elapsed / messages);
+    }
+
+    shutdown(g_sender, SHUT_RDWR);
+    pthread_join(thread, NULL);
+    close(g_sender);
+    close(peer.fd);
+    g_sender = -1;
+    return ret;
+}
+
+int main(int argc, char *argv[]) {
+    int messages = argc > 1 ? atoi(argv[1]) : BENCH_MESSAGES;
+    uint payload_len = argc > 2 ? (uint)atoi(argv[2]) : BENCH_PAYLOAD;
+    int ret = EXIT_SUCCESS;
+
+    if (messages <= 0 || payload_len == 0 || payload_len > TMUX_RING_SIZE) {
+        fprintf(stderr, "usage: %s [messages] [payload bytes, 1..%d]\n", argv[0], TMUX_RING_SIZE);
+        return EXIT_FAILURE;
+    }
+
+    printf("%u byte payload, %zu byte frames, %d round trips\n",
+           payload_len, sizeof(tcp_mux_header_t) + payload_len, messages);
+    printf("%-20s %10s %10s %10s %10s\n", "path", "segs/msg", "bytes/seg", "sends/msg", "us/msg");
+    for (size_t c = 0; c < BENCH_CASES; c++) {
+        if (run_case(&g_cases[c], messages, payload_len) < 0) {
+            ret = EXIT_FAILURE;
+        }
+    }
+    return ret;
+}
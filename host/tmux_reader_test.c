@@ -0,0 +1,302 @@
+/********************************************************************\
+ * This program is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as   *
+ * published by the Free Software Foundation; either version 2 of   *
+ * the License, or (at your option) any later version.              *
+ *                                                                  *
+ * This program is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of   *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the    *
+ * GNU General Public License for more details.                     *
+ *                                                                  *
+ * You should have received a copy of the GNU General Public License*
+ * along with this program; if not, contact:                        *
+ *                                                                  *
+ * Free Software Foundation           Voice:  +1-617-542-5942       *
+ * 59 Temple Place - Suite 330        Fax:    +1-617-542-2652       *
+ * Boston, MA  02111-1307,  USA       gnu@gnu.org                   *
+ *                                                                  *
+\********************************************************************/
+
+/** @file tmux_reader_test.c
+    @author Copyright (C) 2025 LYC <365256281@qq.com>
+*/
+
+// Feeds random tcp mux frames to tmux_reader_next() in random splits,
+// through tmux_reader_push() and through tmux_reader_fill() on a socket
+// pair, and checks that every frame and payload byte comes back intact.
+// Splits land inside the 12-byte header and across the TMUX_RING_SIZE wrap.
+// Half the rounds vary the buffer size per call, down to 0, the way
+// control.c sizes it by the free space of the frame's stream.
+//
+// Usage: tmux_reader_test [rounds [seed]]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "platform.h"
+#include "tcpmux.h"
+
+#define TEST_ROUNDS         40
+#define TEST_FRAMES         300     // frames per round
+#define TEST_PAYLOAD_MAX    6000    // above the ring size, so large frames are streamed
+#define TEST_BUF_SIZE       2047    // what control.c passes: RX_BUFFER_SIZE - 1
+#define TEST_HDR_SIZE       sizeof(tcp_mux_header_t)
+
+typedef struct test_frame {
+    uchar   type;
+    ushort  flags;
+    uint    stream_id;
+    uint    length;
+    uint    pos;        // offset of the header in the stream
+} test_frame_t;
+
+static test_frame_t g_frames[TEST_FRAMES];
+static uchar        *g_stream;
+static size_t       g_stream_len;
+
+static unsigned long g_hdr_splits;      // feed boundaries inside a header
+static unsigned long g_hdr_wraps;       // headers parsed across the ring end
+static unsigned long g_payload_wraps;   // payload chunks taken across the ring end
+static int g_vary;                      // round passes varying buffer sizes, 0 included
+
+static uint rand_below(uint n) {
+    return (uint)rand() % n;
+}
+
+/**
+ * Build a random frame sequence and its wire image
+ */
+static void build_stream() {
+    size_t cap = TEST_FRAMES * (TEST_HDR_SIZE + TEST_PAYLOAD_MAX);
+
+    g_stream = realloc(g_stream, cap);
+    g_stream_len = 0;
+    for (int i = 0; i < TEST_FRAMES; i++) {
+        test_frame_t *f = &g_frames[i];
+        uint pick = rand_below(10);
+
+        f->type = pick < 7 ? DATA : (pick < 9 ? WINDOW_UPDATE : PING);
+        f->flags = rand_below(16);
+        f->stream_id = 1 + 2 * rand_below(64);
+        if (DATA != f->type) {
+            f->length = rand();
+        } else if (pick < 1) {
+            f->length = 0;
+        } else if (pick < 5) {
+            f->length = 1 + rand_below(64);
+        } else {
+            f->length = 1 + rand_below(TEST_PAYLOAD_MAX);
+        }
+        f->pos = g_stream_len;
+
+        tcp_mux_header_t hdr = {
+            .version = 0,
+            .type = f->type,
+            .flags = htons(f->flags),
+            .stream_id = htonl(f->stream_id),
+            .length = htonl(f->length),
+        };
+        memcpy(g_stream + g_stream_len, &hdr, TEST_HDR_SIZE);
+        g_stream_len += TEST_HDR_SIZE;
+        if (DATA == f->type) {
+            for (uint k = 0; k < f->length; k++) {
+                g_stream[g_stream_len++] = (uchar)(i * 131 + k * 7 + (k >> 8));
+            }
+        }
+    }
+}
+
+typedef struct test_check {
+    int     frame;      // next frame expected
+    uint    offset;     // payload bytes of it already checked
+} test_check_t;
+
+/**
+ * Drain every frame the reader can produce and compare with the stream
+ * @return 0 on success, -1 on a mismatch
+ */
+static int drain(tmux_reader_t *reader, test_check_t *chk) {
+    static uchar buf[TEST_BUF_SIZE];
+    tmux_frame_t frame;
+
+    for (;;) {
+        uint head = reader->head;
+        int in_frame = reader->in_frame;
+        if (!in_frame && reader->count >= TEST_HDR_SIZE && head + TEST_HDR_SIZE > TMUX_RING_SIZE) {
+            g_hdr_wraps++;
+        }
+        // Like control.c, size each call by what the frame's stream can take
+        const tmux_frame_t *peek = tmux_reader_peek(reader);
+        uint size = sizeof(buf);
+        if (peek && chk->frame < TEST_FRAMES && peek->stream_id != g_frames[chk->frame].stream_id) {
+            fprintf(stderr, "frame %d: peek saw stream %u\n", chk->frame, peek->stream_id);
+            return -1;
+        }
+        if (g_vary && rand_below(2)) {
+            size = rand_below(8) ? 1 + rand_below(sizeof(buf)) : 0;
+        }
+        if (!tmux_reader_next(reader, &frame, buf, size) &&
+            (size == sizeof(buf) || !tmux_reader_next(reader, &frame, buf, size = sizeof(buf)))) {
+            return 0;
+        }
+        if (in_frame && frame.len && head + frame.len > TMUX_RING_SIZE) {
+            g_payload_wraps++;
+        }
+        if (chk->frame >= TEST_FRAMES) {
+            fprintf(stderr, "frame beyond the end of the stream\n");
+            return -1;
+        }
+
+        const test_frame_t *f = &g_frames[chk->frame];
+        if (frame.type != f->type || frame.flags != f->flags ||
+            frame.stream_id != f->stream_id || frame.length != f->length) {
+            fprintf(stderr, "frame %d: header mismatch, type %u/%u stream %u/%u length %u/%u\n",
+                    chk->frame, frame.type, f->type, frame.stream_id, f->stream_id, frame.length, f->length);
+            return -1;
+        }
+        if (DATA == f->type && f->length) {
+            if (frame.offset != chk->offset || frame.len == 0 || frame.len > size ||
+                frame.offset + frame.len > f->length) {
+                fprintf(stderr, "frame %d: chunk %u+%u, expected offset %u\n",
+                        chk->frame, frame.offset, frame.len, chk->offset);
+                return -1;
+            }
+            if (!g_vary && f->length <= sizeof(buf) && frame.len != f->length) {
+                fprintf(stderr, "frame %d: %u bytes fit the buffer but came in a %u byte chunk\n",
+                        chk->frame, f->length, frame.len);
+                return -1;
+            }
+            if (memcmp(buf, g_stream + f->pos + TEST_HDR_SIZE + frame.offset, frame.len)) {
+                fprintf(stderr, "frame %d: payload differs at %u\n", chk->frame, frame.offset);
+                return -1;
+            }
+            chk->offset += frame.len;
+        }
+        if (frame.last != (DATA != f->type || chk->offset == f->length)) {
+            fprintf(stderr, "frame %d: last %d at offset %u\n", chk->frame, frame.last, chk->offset);
+            return -1;
+        }
+        if (frame.last) {
+            chk->frame++;
+            chk->offset = 0;
+        }
+    }
+}
+
+/**
+ * Length of the next feed: mostly small, sometimes large
+ */
+static size_t next_split(size_t left) {
+    size_t n;
+
+    switch (rand_below(4)) {
+    case 0:  n = 1 + rand_below(TEST_HDR_SIZE); break;
+    case 1:  n = 1 + rand_below(256); break;
+    default: n = 1 + rand_below(2 * TMUX_RING_SIZE); break;
+    }
+    return n < left ? n : left;
+}
+
+/**
+ * Count feed boundaries that fall inside a frame header
+ */
+static void count_header_split(size_t boundary, int *hint) {
+    while (*hint < TEST_FRAMES && g_frames[*hint].pos + TEST_HDR_SIZE <= boundary) {
+        (*hint)++;
+    }
+    if (*hint < TEST_FRAMES && boundary > g_frames[*hint].pos) {
+        g_hdr_splits++;
+    }
+}
+
+/**
+ * One round: feed the stream in random splits, with push or with fill
+ * @return 0 on success
+ */
+static int run_round(int use_fill) {
+    static tmux_reader_t reader;
+    test_check_t chk = { 0, 0 };
+    int sv[2] = { -1, -1 };
+    int hint = 0;
+    size_t fed = 0;
+
+    tmux_reader_init(&reader);
+    build_stream();
+    if (use_fill && socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        perror("socketpair");
+        return -1;
+    }
+
+    while (fed < g_stream_len) {
+        size_t n = next_split(g_stream_len - fed);
+        uint room = TMUX_RING_SIZE - reader.count;
+        if (n > room) {
+            n = room;           // Like the socket, the ring only takes what fits
+        }
+        if (0 == n) {
+            fprintf(stderr, "ring full and no frame ready at %zu\n", fed);
+            return -1;
+        }
+
+        if (use_fill) {
+            if (write(sv[1], g_stream + fed, n) != (ssize_t)n) {
+                perror("write");
+                return -1;
+            }
+            for (size_t got = 0; got < n; ) {   // fill() takes the contiguous part per call
+                int r = tmux_reader_fill(&reader, sv[0]);
+                if (r <= 0) {
+                    fprintf(stderr, "fill returned %d\n", r);
+                    return -1;
+                }
+                got += r;
+            }
+        } else if (tmux_reader_push(&reader, g_stream + fed, n) != n) {
+            fprintf(stderr, "push took less than the free space\n");
+            return -1;
+        }
+        fed += n;
+        count_header_split(fed, &hint);
+
+        if (drain(&reader, &chk) < 0) {
+            return -1;
+        }
+    }
+
+    if (use_fill) {
+        close(sv[0]);
+        close(sv[1]);
+    }
+    if (chk.frame != TEST_FRAMES || reader.count != 0 || reader.in_frame) {
+        fprintf(stderr, "%d of %d frames, %u bytes left over\n", chk.frame, TEST_FRAMES, reader.count);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int rounds = argc > 1 ? atoi(argv[1]) : TEST_ROUNDS;
+    unsigned seed = argc > 2 ? (unsigned)strtoul(argv[2], NULL, 0) : 1;
+
+    srand(seed);
+    for (int r = 0; r < rounds; r++) {
+        g_vary = (r >> 1) & 1;
+        if (run_round(r & 1) < 0) {
+            fprintf(stderr, "FAIL: round %d (%s, %s sizes), seed %u\n", r, r & 1 ? "fill" : "push",
+                    g_vary ? "varying" : "fixed", seed);
+            return EXIT_FAILURE;
+        }
+    }
+    if (0 == g_hdr_splits || 0 == g_hdr_wraps || 0 == g_payload_wraps) {
+        fprintf(stderr, "FAIL: splits not covered, header %lu, header wrap %lu, payload wrap %lu\n",
+                g_hdr_splits, g_hdr_wraps, g_payload_wraps);
+        return EXIT_FAILURE;
+    }
+    printf("PASS: %d rounds of %d frames, %lu splits inside headers, %lu headers and %lu payloads across the ring wrap\n",
+           rounds, TEST_FRAMES, g_hdr_splits, g_hdr_wraps, g_payload_wraps);
+    free(g_stream);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,117 @@
+/********************************************************************\
+ * This program is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as   *
+ * published by the Free Software Foundation; either version 2 of   *
+ * the License, or (at your option) any later version.              *
+ *                                                                  *
+ * This program is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of   *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the    *
+ * GNU General Public License for more details.                     *
+ *                                                                  *
+ * You should have received a copy of the GNU General Public License*
+ * along with this program; if not, contact:                        *
+ *                                                                  *
+ * Free Software Foundation           Voice:  +1-617-542-5942       *
+ * 59 Temple Place - Suite 330        Fax:    +1-617-542-2652       *
+ * Boston, MA  02111-1307,  USA       gnu@gnu.org                   *
+ *                                                                  *
+\********************************************************************/
+
+/** @file boottrace.c
+    @author Copyright (C) 2025 LYC <365256281@qq.com>
+*/
+
+#include <stdio.h>
+#include "platform.h"
+#include "boottrace.h"
+
+static const char *TAG = "boot";
+
+static int64_t g_boot_us[BOOT_PHASES];    // 0: not reached yet
+
+static const char *const g_phase_names[BOOT_PHASES] = {
+    [BOOT_NVS]             = "nvs",
+    [BOOT_CONFIG]          = "config",
+    [BOOT_GPIO]            = "gpio",
+    [BOOT_TIMER]           = "timer",
+    [BOOT_MODE]            = "mode",
+    [BOOT_WIFI]            = "wifi",
+    [BOOT_INIT]            = "init",
+    [BOOT_CLOCK]           = "clock",
+    [BOOT_TCP_CONNECTED]   = "tcp_connected",
+    [BOOT_LOGIN_RESP]      = "login_resp",
+    [BOOT_IV]              = "iv",
+    [BOOT_NEW_PROXY_RESP]  = "new_proxy_resp",
+    [BOOT_START_WORK_CONN] = "start_work_conn",
+};
+
+/**
+ * Record that a phase has completed, only the first time
+ * Cheap enough for any path: one timer read and a store.
+ * @param phase Phase reached
+ */
+void boot_mark(boot_phase_t phase) {
+    if (0 == g_boot_us[phase]) {
+        int64_t now = plat_now_us();
+        g_boot_us[phase] = now ? now : 1;
+    }
+}
+
+/**
+ * Get when a phase completed
+ * @param phase Phase
+ * @return Microseconds since boot, 0 if not reached
+ */
+int64_t boot_phase_us(boot_phase_t phase) {
+    return g_boot_us[phase];
+}
+
+/**
+ * Format the timeline as text, one phase per line
+ * Each line gives the time since boot and since the previous reached
+ * phase, in ms with us resolution.
+ * @param buf Output buffer
+ * @param size Size of buf
+ * @return Length written, excluding the NUL
+ */
+size_t boot_trace_format(char *buf, size_t size) {
+    size_t len = 0;
+    int64_t prev = 0;
+
+    for (int i = 0; i < BOOT_PHASES && len < size; i++) {
+        int64_t t = g_boot_us[i];
+        int n;
+
+        if (0 == t) {
+            n = snprintf(buf + len, size - len, "%-16s        -\n", g_phase_names[i]);
+        } else {
+            n = snprintf(buf + len, size - len, "%-16s %8u.%03u +%u.%03u ms\n", g_phase_names[i],
+                         (uint32_t)(t / 1000), (uint32_t)(t % 1000),
+                         (uint32_t)((t - prev) / 1000), (uint32_t)((t - prev) % 1000));
+            prev = t;
+        }
+        if (n < 0) {
+            break;
+        }
+        len += (size_t)n < size - len ? (size_t)n : size - len - 1;
+    }
+    return len;
+}
+
+/**
+ * Log the timeline over the console UART
+ */
+void boot_trace_dump(void) {
+    int64_t prev = 0;
+
+    for (int i = 0; i < BOOT_PHASES; i++) {
+        int64_t t = g_boot_us[i];
+        if (t) {
+            ESP_LOGI(TAG, "%-16s %8u.%03u ms  +%u.%03u", g_phase_names[i],
+                     (uint32_t)(t / 1000), (uint32_t)(t % 1000),
+                     (uint32_t)((t - prev) / 1000), (uint32_t)((t - prev) % 1000));
+            prev = t;
+        }
+    }
+}
@@ -0,0 +1,60 @@
+/********************************************************************\
+ * This program is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as   *
+ * published by the Free Software Foundation; either version 2 of   *
+ * the License, or (at your option) any later version.              *
+ *                                                                  *
+ * This program is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of   *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the    *
+ * GNU General Public License for more details.                     *
+ *                                                                  *
+ * You should have received a copy of the GNU General Public License*
+ * along with this program; if not, contact:                        *
+ *                                                                  *
+ * Free Software Foundation           Voice:  +1-617-542-5942       *
+ * 59 Temple Place - Suite 330        Fax:    +1-617-542-2652       *
+ * Boston, MA  02111-1307,  USA       gnu@gnu.org                   *
+ *                                                                  *
+\********************************************************************/
+
+/** @file boottrace.h
+    @author Copyright (C) 2025 LYC <365256281@qq.com>
+*/
+
+#ifndef BOOTTRACE_H
+#define BOOTTRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Boot timeline: the first time each phase completes, in us since boot.
+// Startup phases are marked by app_main(), protocol milestones by the
+// control session; later sessions do not overwrite them.
+
+typedef enum boot_phase {
+	BOOT_NVS,				// nvs_flash_init()
+	BOOT_CONFIG,			// config_init(), device config loaded
+	BOOT_GPIO,				// GPIO pins and KEY interrupt
+	BOOT_TIMER,				// LED timer created
+	BOOT_MODE,				// check_config_mode()
+	BOOT_WIFI,				// station connected
+	BOOT_INIT,				// initialize(): login, config, key, clock service
+	BOOT_CLOCK,				// wall time valid
+	BOOT_TCP_CONNECTED,		// connected to frps
+	BOOT_LOGIN_RESP,		// LoginResp accepted
+	BOOT_IV,				// frps's IV received
+	BOOT_NEW_PROXY_RESP,	// proxy registered
+	BOOT_START_WORK_CONN,	// first StartWorkConn
+	BOOT_PHASES,
+} boot_phase_t;
+
+void boot_mark(boot_phase_t phase);
+
+int64_t boot_phase_us(boot_phase_t phase);
+
+size_t boot_trace_format(char *buf, size_t size);
+
+void boot_trace_dump(void);
+
+#endif
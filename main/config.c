@@ -1,3 +1,4 @@
+#include <stddef.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
@@ -9,7 +10,13 @@
 #include "nvs_flash.h"
 #include "config.h"
 #include "driver/gpio.h"
+#include "esp8266/gpio_register.h"
 #include "timer.h"
+#include "esp_attr.h"
+#include "platform.h"
+#include "control.h"
+#include "login.h"
+#include "configstore.h"
 
 static const char *TAG = "CONFIG";
 
@@ -24,7 +31,7 @@ const device_config_t default_config = {
     .proxy_name = "ssh-ubuntu",
     .proxy_type = "tcp",
     .local_ip = "127.0.0.1",
-    .local_port = 22,
+    .local_port = 0,             // 0: the built-in relay service
     .remote_port = 7005,
     .heartbeat_interval = 30,
     .heartbeat_timeout = 90,
@@ -56,129 +63,97 @@ esp_err_t config_init(void)
     return ESP_OK;
 }
 
+// 旧版按键存储的配置项（config/nvs_data.csv仍按此格式烧录），首次启动时转换为配置blob
+#define LEGACY_STR(k, f)    { k, offsetof(device_config_t, f), sizeof(((device_config_t *)0)->f), false }
+#define LEGACY_U16(k, f)    { k, offsetof(device_config_t, f), sizeof(uint16_t), true }
+
+typedef struct legacy_key {
+    const char *key;
+    size_t      offset;
+    size_t      size;
+    bool        u16;
+} legacy_key_t;
+
+static const legacy_key_t legacy_keys[] = {
+    LEGACY_STR("wifi_ssid", wifi_ssid),
+    LEGACY_STR("wifi_password", wifi_password),
+    LEGACY_STR("wifi_enc", wifi_encryption),
+    LEGACY_STR("frp_srv", frp_server),
+    LEGACY_U16("frp_port", frp_port),
+    LEGACY_STR("frp_tok", frp_token),
+    LEGACY_STR("prx_name", proxy_name),
+    LEGACY_STR("prx_type", proxy_type),
+    LEGACY_STR("loc_ip", local_ip),
+    LEGACY_U16("loc_port", local_port),
+    LEGACY_U16("rmt_port", remote_port),
+    LEGACY_U16("hb_itvl", heartbeat_interval),
+    LEGACY_U16("hb_to", heartbeat_timeout),
+};
+
 /**
- * 从NVS加载配置
+ * 读取旧版按键存储的配置，缺少的项保留默认值
+ * @param cfg 输入默认配置，输出读到的配置
+ * @return _SUCCESS 找到旧版配置，_FAIL 未找到
  */
- // ... existing code ...
-esp_err_t config_load_from_nvs(void)
+static int config_load_legacy(device_config_t *cfg)
 {
     nvs_handle nvs_handle;
-    esp_err_t err;
-
-    err = nvs_open("config", NVS_READONLY, &nvs_handle);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error opening NVS handle: %s", esp_err_to_name(err));
-        return err;
-    }
-
     uint32_t version = 0;
-    err = nvs_get_u32(nvs_handle, "version", &version);
-    if (err != ESP_OK) goto fail;
+    int missing = 0;
 
-    if (version != default_config.config_version) {
+    if (nvs_open(CONFIG_NVS_NS, NVS_READONLY, &nvs_handle) != ESP_OK) {
+        return _FAIL;
+    }
+    if (nvs_get_u32(nvs_handle, "version", &version) != ESP_OK) {
         nvs_close(nvs_handle);
-        return ESP_ERR_INVALID_VERSION;
+        return _FAIL;
     }
 
-    size_t len;
-    len = sizeof(g_device_config.wifi_ssid);
-    err = nvs_get_str(nvs_handle, "wifi_ssid", g_device_config.wifi_ssid, &len);
-    if (err != ESP_OK) goto fail;
-    len = sizeof(g_device_config.wifi_password);
-    err = nvs_get_str(nvs_handle, "wifi_password", g_device_config.wifi_password, &len);
-    if (err != ESP_OK) goto fail;
-    len = sizeof(g_device_config.wifi_encryption);
-    err = nvs_get_str(nvs_handle, "wifi_enc", g_device_config.wifi_encryption, &len);
-    if (err != ESP_OK) goto fail;
-    len = sizeof(g_device_config.frp_server);
-    err = nvs_get_str(nvs_handle, "frp_srv", g_device_config.frp_server, &len);
-    if (err != ESP_OK) goto fail;
-    err = nvs_get_u16(nvs_handle, "frp_port", &g_device_config.frp_port);
-    if (err != ESP_OK) goto fail;
-    len = sizeof(g_device_config.frp_token);
-    err = nvs_get_str(nvs_handle, "frp_tok", g_device_config.frp_token, &len);
-    if (err != ESP_OK) goto fail;
-    len = sizeof(g_device_config.proxy_name);
-    err = nvs_get_str(nvs_handle, "prx_name", g_device_config.proxy_name, &len);
-    if (err != ESP_OK) goto fail;
-    len = sizeof(g_device_config.proxy_type);
-    err = nvs_get_str(nvs_handle, "prx_type", g_device_config.proxy_type, &len);
-    if (err != ESP_OK) goto fail;
-    len = sizeof(g_device_config.local_ip);
-    err = nvs_get_str(nvs_handle, "loc_ip", g_device_config.local_ip, &len);
-    if (err != ESP_OK) goto fail;
-    err = nvs_get_u16(nvs_handle, "loc_port", &g_device_config.local_port);
-    if (err != ESP_OK) goto fail;
-    err = nvs_get_u16(nvs_handle, "rmt_port", &g_device_config.remote_port);
-    if (err != ESP_OK) goto fail;
-    err = nvs_get_u16(nvs_handle, "hb_itvl", &g_device_config.heartbeat_interval);
-    if (err != ESP_OK) goto fail;
-    err = nvs_get_u16(nvs_handle, "hb_to", &g_device_config.heartbeat_timeout);
-    if (err != ESP_OK) goto fail;
-    g_device_config.config_version = version;
-
+    for (int i = 0; i < sizeof(legacy_keys) / sizeof(legacy_keys[0]); i++) {
+        const legacy_key_t *k = &legacy_keys[i];
+        uint8_t *field = (uint8_t *)cfg + k->offset;
+        size_t len = k->size;
+        esp_err_t err = k->u16 ? nvs_get_u16(nvs_handle, k->key, (uint16_t *)field)
+                               : nvs_get_str(nvs_handle, k->key, (char *)field, &len);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Legacy config item %s: %s, keeping default", k->key, esp_err_to_name(err));
+            missing++;
+        }
+    }
     nvs_close(nvs_handle);
-    ESP_LOGI(TAG, "Configuration loaded from NVS successfully");
-    return ESP_OK;
 
-fail:
-    ESP_LOGE(TAG, "Error reading config item: %s", esp_err_to_name(err));
-    nvs_close(nvs_handle);
-    return err;
+    ESP_LOGI(TAG, "Legacy config version %u read, %d items missing", version, missing);
+    return _SUCCESS;
 }
-// ... existing code ...
-esp_err_t config_save_to_nvs(void)
+
+/**
+ * 从NVS加载配置：正常情况下只读一次主配置槽
+ */
+esp_err_t config_load_from_nvs(void)
 {
-    nvs_handle nvs_handle;
-    esp_err_t err;
+    int64_t start = plat_now_us();
+    config_origin_t origin = config_store_load(&g_device_config, config_load_legacy);
 
-    err = nvs_open("config", NVS_READWRITE, &nvs_handle);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error opening NVS handle: %s", esp_err_to_name(err));
-        return err;
+    if (origin == CONFIG_FROM_NONE) {
+        return ESP_ERR_NOT_FOUND;
     }
+    ESP_LOGI(TAG, "Configuration loaded from %s in %u us", config_origin_name(origin),
+             (uint32_t)(plat_now_us() - start));
+    return ESP_OK;
+}
 
-    err = nvs_set_u32(nvs_handle, "version", g_device_config.config_version);
-    if (err != ESP_OK) goto fail;
-
-    err = nvs_set_str(nvs_handle, "wifi_ssid", g_device_config.wifi_ssid);
-    if (err != ESP_OK) goto fail;
-    err = nvs_set_str(nvs_handle, "wifi_password", g_device_config.wifi_password);
-    if (err != ESP_OK) goto fail;
-    err = nvs_set_str(nvs_handle, "wifi_enc", g_device_config.wifi_encryption);
-    if (err != ESP_OK) goto fail;
-    err = nvs_set_str(nvs_handle, "frp_srv", g_device_config.frp_server);
-    if (err != ESP_OK) goto fail;
-    err = nvs_set_u16(nvs_handle, "frp_port", g_device_config.frp_port);
-    if (err != ESP_OK) goto fail;
-    err = nvs_set_str(nvs_handle, "frp_tok", g_device_config.frp_token);
-    if (err != ESP_OK) goto fail;
-    err = nvs_set_str(nvs_handle, "prx_name", g_device_config.proxy_name);
-    if (err != ESP_OK) goto fail;
-    err = nvs_set_str(nvs_handle, "prx_type", g_device_config.proxy_type);
-    if (err != ESP_OK) goto fail;
-    err = nvs_set_str(nvs_handle, "loc_ip", g_device_config.local_ip);
-    if (err != ESP_OK) goto fail;
-    err = nvs_set_u16(nvs_handle, "loc_port", g_device_config.local_port);
-    if (err != ESP_OK) goto fail;
-    err = nvs_set_u16(nvs_handle, "rmt_port", g_device_config.remote_port);
-    if (err != ESP_OK) goto fail;
-    err = nvs_set_u16(nvs_handle, "hb_itvl", g_device_config.heartbeat_interval);
-    if (err != ESP_OK) goto fail;
-    err = nvs_set_u16(nvs_handle, "hb_to", g_device_config.heartbeat_timeout);
-    if (err != ESP_OK) goto fail;
-
-    err = nvs_commit(nvs_handle);
-    if (err != ESP_OK) goto fail;
+/**
+ * 保存配置到NVS：整体写入备份槽和主配置槽
+ */
+esp_err_t config_save_to_nvs(void)
+{
+    int64_t start = plat_now_us();
 
-    nvs_close(nvs_handle);
-    ESP_LOGI(TAG, "Configuration saved to NVS successfully");
+    if (config_store_save(&g_device_config) != _SUCCESS) {
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Configuration saved to NVS in %u us", (uint32_t)(plat_now_us() - start));
     return ESP_OK;
-
-fail:
-    ESP_LOGE(TAG, "Error writing config item: %s", esp_err_to_name(err));
-    nvs_close(nvs_handle);
-    return err;
 }
 // ... existing code ...
 /**
@@ -216,44 +191,114 @@ void config_print(void)
     ESP_LOGI(TAG, "================================");
 } 
 
+// Boot mode request kept in RTC memory across the restart that applies it
+typedef struct boot_request {
+    uint32_t magic;
+    uint32_t config;    // 1: config mode, 0: normal mode
+} boot_request_t;
+
+static volatile TickType_t key_down_tick = 0;   // debounced press start, 0 while released
+static volatile TickType_t key_edge_tick = 0;   // last accepted edge
+static bool key_long_handled = false;
+
+/**
+ * KEY edge interrupt
+ * Debounced by ignoring edges closer than KEY_DEBOUNCE_MS to the last one
+ * taken; only records when the key went down, the timer task judges the
+ * hold time. A release dropped as bounce is caught by config_key_poll().
+ * Reads the input register directly, gpio_get_level() is not in IRAM.
+ */
+static void IRAM_ATTR key_isr_handler(void *arg)
+{
+    TickType_t now = xTaskGetTickCountFromISR();
+
+    if (key_edge_tick && (now - key_edge_tick) < pdMS_TO_TICKS(KEY_DEBOUNCE_MS)) {
+        return;
+    }
+    key_edge_tick = now ? now : 1;
+    if (0 == ((GPIO_REG_READ(GPIO_IN_ADDRESS) >> KEY) & 1)) {  // 按钮按下（低电平）
+        key_down_tick = key_edge_tick;
+    } else {
+        key_down_tick = 0;
+    }
+}
+
+/**
+ * Arm the KEY interrupt, normal startup goes on without waiting for it
+ * A press still held from before this boot, such as the long press that
+ * asked for it, must be released before a new long press counts.
+ */
+void config_key_init(void)
+{
+    key_long_handled = (gpio_get_level(KEY) == 0);
+    gpio_set_intr_type(KEY, GPIO_INTR_ANYEDGE);
+    gpio_install_isr_service(0);
+    gpio_isr_handler_add(KEY, key_isr_handler, NULL);
+}
+
+/**
+ * Restart into config mode or normal mode
+ * @param config true for config mode on the next boot
+ */
+void config_request_mode(bool config)
+{
+    boot_request_t req = { BOOT_REQUEST_MAGIC, config ? 1 : 0 };
+
+    ESP_LOGI(TAG, "Restarting into %s mode", config ? "config" : "normal");
+    plat_rtc_store(PLAT_RTC_BOOT, &req, sizeof(req));
+    plat_restart();
+}
+
+/**
+ * Check for a long KEY press, called every timer tick (0.1 s)
+ * A long press switches modes: normal to config, config back to normal.
+ * The level is read again here, so an edge the ISR dropped as bounce
+ * cannot leave the key looking held, or miss a press.
+ */
+void config_key_poll(void)
+{
+    TickType_t down = key_down_tick;
+
+    if (gpio_get_level(KEY) != 0) {  // Released
+        key_down_tick = down = 0;
+    } else if (0 == down) {
+        TickType_t now = xTaskGetTickCount();
+        key_down_tick = down = now ? now : 1;
+    }
+    if (0 == down) {
+        key_long_handled = false;
+        return;
+    }
+    if (!key_long_handled && (xTaskGetTickCount() - down) >= pdMS_TO_TICKS(KEY_LONG_PRESS_MS)) {
+        key_long_handled = true;
+        gpio_set_level(LINK_LED, 0);  // 点亮net灯表示切换模式
+        config_request_mode(!config_mode);
+    }
+}
+
 /**
  * 检查是否进入配置模式
- * 上电10秒内net灯闪烁（0.5秒切换），检查按钮状态
+ * No longer waits: config mode is entered only when the previous boot asked
+ * for it (long press or config_request_mode()). The request is one-shot,
+ * the boot after that is normal again. KEY is GPIO0, which held low at
+ * reset selects the ROM download mode, so it cannot be read at power on.
  */
 bool check_config_mode()
 {
-    ESP_LOGI("MAIN", "Checking for config mode (10 seconds)...");
-    uint32_t start_tick = get_tick_count();
-    bool led_blink_state = false;
-    
-    // 10秒 = 100个滴答
-    uint32_t relative_tick = 0;
-    while (relative_tick < 100) {
-        relative_tick = get_tick_count() - start_tick;
-        
-        // tickcnt == 100 时结束循环
-        if (relative_tick >= 100) {
-            break;
-        }
-        
-        // NET LED闪烁 - 每5个滴答(0.5秒)切换一次状态
-        if (relative_tick % 5 == 0 && relative_tick > 0) {
-            led_blink_state = !led_blink_state;
-            gpio_set_level(LINK_LED, led_blink_state ? 0 : 1);  // 0=亮，1=灭
-        }
-        
-        // 检查按钮状态（直接读电平）
-        if (gpio_get_level(KEY) == 0) {  // 按钮按下（低电平）
-            ESP_LOGI("MAIN", "Button pressed! Entering config mode...");
-            gpio_set_level(LINK_LED, 0);  // 点亮net灯表示进入配置模式
-            return true;
-        }
-        
-        // 短暂延时避免CPU占用过高
-        vTaskDelay(1 / portTICK_PERIOD_MS);
+    boot_request_t req;
+    bool config = false;
+
+    if (_SUCCESS == plat_rtc_load(PLAT_RTC_BOOT, &req, sizeof(req)) && BOOT_REQUEST_MAGIC == req.magic) {
+        config = req.config != 0;
+        req.magic = 0;
+        plat_rtc_store(PLAT_RTC_BOOT, &req, sizeof(req));
     }
-    
-    ESP_LOGI("MAIN", "No button press detected. Entering normal mode...");
-    gpio_set_level(LINK_LED, 1);  // 关闭net灯
-    return false;
+    if (config) {
+        ESP_LOGI("MAIN", "Entering config mode...");
+        gpio_set_level(LINK_LED, 0);  // 点亮net灯表示进入配置模式
+    } else {
+        ESP_LOGI("MAIN", "Entering normal mode, hold the button %d s for config mode", KEY_LONG_PRESS_MS / 1000);
+        gpio_set_level(LINK_LED, 1);  // 关闭net灯
+    }
+    return config;
 } 
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define CONFIG_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 // GPIO pin definitions
 #define RELAY               5       // Relay control pin (1:ON/0:OFF)
@@ -13,6 +14,11 @@
 #define GPIO_OUTPUT_PIN_SEL ((1ULL<<RELAY) | (1ULL<<POWER_LED) | (1ULL<<LINK_LED))
 #define GPIO_INPUT_PIN_SEL  ((1ULL<<KEY))
 
+// Config mode switching by KEY
+#define KEY_DEBOUNCE_MS     30      // edges closer than this are contact bounce
+#define KEY_LONG_PRESS_MS   3000    // hold time that switches between normal and config mode
+#define BOOT_REQUEST_MAGIC  0x424f4f54  // "BOOT"
+
 // 配置结构体 - 包含所有可配置的参数
 typedef struct {
     // WiFi配置
@@ -55,5 +61,8 @@ esp_err_t config_reset_to_default(void);
 void config_print(void);
 
 bool check_config_mode(void);
+void config_key_init(void);
+void config_key_poll(void);
+void config_request_mode(bool config);
 
 #endif // CONFIG_H 
\ No newline at end of file
@@ -0,0 +1,173 @@
+/********************************************************************\
+ * This program is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as   *
+ * published by the Free Software Foundation; either version 2 of   *
+ * the License, or (at your option) any later version.              *
+ *                                                                  *
+ * This program is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of   *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the    *
+ * GNU General Public License for more details.                     *
+ *                                                                  *
+ * You should have received a copy of the GNU General Public License*
+ * along with this program; if not, contact:                        *
+ *                                                                  *
+ * Free Software Foundation           Voice:  +1-617-542-5942       *
+ * 59 Temple Place - Suite 330        Fax:    +1-617-542-2652       *
+ * Boston, MA  02111-1307,  USA       gnu@gnu.org                   *
+ *                                                                  *
+\********************************************************************/
+
+/** @file configstore.c
+    @author Copyright (C) 2025 LYC <365256281@qq.com>
+*/
+
+#include <string.h>
+#include "platform.h"
+#include "tcpmux.h"
+#include "login.h"
+#include "configstore.h"
+
+#define CONFIG_BLOB_HDR		offsetof(config_blob_t, cfg)
+#define CONFIG_CRC_FROM		offsetof(config_blob_t, version)
+
+static const char *TAG = "cfgstore";
+
+/**
+ * CRC-32 (IEEE 802.3), a nibble at a time to keep the table at 64 bytes
+ */
+static uint32_t crc32(const uint8_t *data, size_t len) {
+    static const uint32_t table[16] = {
+        0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+        0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+    };
+    uint32_t crc = 0xffffffff;
+
+    while (len--) {
+        crc ^= *data++;
+        crc = (crc >> 4) ^ table[crc & 0xf];
+        crc = (crc >> 4) ^ table[crc & 0xf];
+    }
+    return ~crc;
+}
+
+/**
+ * Bring a blob written by an older firmware up to the current layout.
+ * Fields are only ever appended to device_config_t, so an older payload is
+ * a prefix of the current one and the new fields keep their defaults. A
+ * layout change that is not an append converts its version here.
+ * @param blob Verified blob, version older than cfg's
+ * @param cfg In: defaults, out: the migrated configuration
+ * @return _SUCCESS, or _FAIL if the blob cannot be converted
+ */
+static int config_migrate(const config_blob_t *blob, device_config_t *cfg) {
+    uint32_t current = cfg->config_version;
+
+    if (blob->size > sizeof(*cfg)) {
+        return _FAIL;
+    }
+    memcpy(cfg, &blob->cfg, blob->size);
+    cfg->config_version = current;
+    ESP_LOGI(TAG, "config migrated from version %u to %u", blob->version, current);
+    return _SUCCESS;
+}
+
+/**
+ * Read and verify one slot
+ * @param key Slot key
+ * @param cfg In: defaults, out: the configuration in the slot
+ * @param migrated Set when the slot held an older version
+ * @return _SUCCESS, or _FAIL if the slot is missing, damaged or newer
+ */
+static int read_slot(const char *key, device_config_t *cfg, int *migrated) {
+    config_blob_t blob;
+    size_t len = sizeof(blob);
+
+    if (_SUCCESS != plat_nvs_get_blob(CONFIG_NVS_NS, key, &blob, &len)) {
+        return _FAIL;
+    }
+    if (len < CONFIG_BLOB_HDR || blob.magic != CONFIG_BLOB_MAGIC || len != CONFIG_BLOB_HDR + blob.size ||
+        blob.crc != crc32((const uint8_t *)&blob + CONFIG_CRC_FROM, len - CONFIG_CRC_FROM)) {
+        ESP_LOGW(TAG, "config slot %s is damaged", key);
+        return _FAIL;
+    }
+    if (blob.version > cfg->config_version) {
+        ESP_LOGW(TAG, "config slot %s is version %u, newer than %u", key, blob.version, cfg->config_version);
+        return _FAIL;
+    }
+    if (blob.version < cfg->config_version) {
+        *migrated = 1;
+        return config_migrate(&blob, cfg);
+    }
+    if (blob.size != sizeof(*cfg)) {
+        ESP_LOGW(TAG, "config slot %s has %u bytes, expected %u", key, blob.size, (uint32_t)sizeof(*cfg));
+        return _FAIL;
+    }
+    memcpy(cfg, &blob.cfg, sizeof(*cfg));
+    return _SUCCESS;
+}
+
+/**
+ * Load the configuration: the primary slot, else the backup, else the legacy hook
+ */
+config_origin_t config_store_load(device_config_t *cfg, config_legacy_fn legacy) {
+    int migrated = 0;
+
+    if (_SUCCESS == read_slot(CONFIG_NVS_PRIMARY, cfg, &migrated)) {
+        if (migrated) {
+            config_store_save(cfg);
+        }
+        return CONFIG_FROM_PRIMARY;
+    }
+    if (_SUCCESS == read_slot(CONFIG_NVS_BACKUP, cfg, &migrated)) {
+        ESP_LOGW(TAG, "restoring the primary config slot from the backup");
+        config_store_save(cfg);
+        return CONFIG_FROM_BACKUP;
+    }
+    if (legacy && _SUCCESS == legacy(cfg)) {
+        ESP_LOGI(TAG, "converting the stored config to a blob");
+        config_store_save(cfg);
+        return CONFIG_FROM_LEGACY;
+    }
+    return CONFIG_FROM_NONE;
+}
+
+/**
+ * Save the configuration as a blob, backup slot first
+ */
+int config_store_save(const device_config_t *cfg) {
+    config_blob_t blob;
+
+    memset(&blob, 0, sizeof(blob));     // Padding too, so equal configs give equal blobs
+    blob.magic = CONFIG_BLOB_MAGIC;
+    blob.version = cfg->config_version;
+    blob.size = sizeof(*cfg);
+    memcpy(&blob.cfg, cfg, sizeof(*cfg));
+    blob.crc = crc32((const uint8_t *)&blob + CONFIG_CRC_FROM, sizeof(blob) - CONFIG_CRC_FROM);
+
+    // Backup first: a power loss while the primary is written leaves this save in the backup
+    if (_SUCCESS != plat_nvs_set_blob(CONFIG_NVS_NS, CONFIG_NVS_BACKUP, &blob, sizeof(blob))) {
+        ESP_LOGW(TAG, "failed to write the backup config slot");
+    }
+    if (_SUCCESS != plat_nvs_set_blob(CONFIG_NVS_NS, CONFIG_NVS_PRIMARY, &blob, sizeof(blob))) {
+        ESP_LOGE(TAG, "failed to write the primary config slot");
+        return _FAIL;
+    }
+    return _SUCCESS;
+}
+
+/**
+ * Printable name of a configuration origin
+ */
+const char *config_origin_name(config_origin_t origin) {
+    switch (origin) {
+    case CONFIG_FROM_PRIMARY:
+        return "primary slot";
+    case CONFIG_FROM_BACKUP:
+        return "backup slot";
+    case CONFIG_FROM_LEGACY:
+        return "per-key nvs";
+    default:
+        return "defaults";
+    }
+}
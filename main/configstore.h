@@ -0,0 +1,84 @@
+/********************************************************************\
+ * This program is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as   *
+ * published by the Free Software Foundation; either version 2 of   *
+ * the License, or (at your option) any later version.              *
+ *                                                                  *
+ * This program is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of   *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the    *
+ * GNU General Public License for more details.                     *
+ *                                                                  *
+ * You should have received a copy of the GNU General Public License*
+ * along with this program; if not, contact:                        *
+ *                                                                  *
+ * Free Software Foundation           Voice:  +1-617-542-5942       *
+ * 59 Temple Place - Suite 330        Fax:    +1-617-542-2652       *
+ * Boston, MA  02111-1307,  USA       gnu@gnu.org                   *
+ *                                                                  *
+\********************************************************************/
+
+/** @file configstore.h
+    @author Copyright (C) 2025 LYC <365256281@qq.com>
+*/
+
+#ifndef CONFIGSTORE_H
+#define CONFIGSTORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+
+// device_config_t is persisted as one blob with a CRC, in two NVS slots.
+// A save writes the backup slot first and the primary slot second, so a
+// power loss leaves at least one complete copy; a load reads the primary
+// slot alone unless it is missing or damaged.
+#define CONFIG_NVS_NS			"config"
+#define CONFIG_NVS_PRIMARY		"cfg_a"
+#define CONFIG_NVS_BACKUP		"cfg_b"
+#define CONFIG_BLOB_MAGIC		0x31474643	// "CFG1"
+
+typedef struct config_blob {
+	uint32_t		magic;		// CONFIG_BLOB_MAGIC
+	uint32_t		crc;		// CRC-32 from version to the end of the payload
+	uint16_t		version;	// config_version of the firmware that wrote it
+	uint16_t		size;		// payload bytes
+	device_config_t	cfg;		// payload, a prefix of it for older versions
+} config_blob_t;
+
+// Where config_store_load() found the configuration
+typedef enum config_origin {
+	CONFIG_FROM_NONE,			// nothing usable, cfg left as given
+	CONFIG_FROM_PRIMARY,
+	CONFIG_FROM_BACKUP,			// primary slot missing or damaged, rewritten
+	CONFIG_FROM_LEGACY,			// legacy hook, saved as a blob
+} config_origin_t;
+
+/**
+ * @brief Reads a configuration kept in a layout older than the blob
+ *
+ * @param cfg In: defaults, out: the fields found
+ * @return _SUCCESS if a configuration was found
+ */
+typedef int (*config_legacy_fn)(device_config_t *cfg);
+
+/**
+ * @brief Load the configuration
+ *
+ * @param cfg In: defaults, whose config_version is the current layout;
+ *            out: the stored configuration, migrated to the current layout
+ * @param legacy Called when neither slot is usable, may be NULL
+ * @return where the configuration came from, CONFIG_FROM_NONE on failure
+ */
+config_origin_t config_store_load(device_config_t *cfg, config_legacy_fn legacy);
+
+/**
+ * @brief Save the configuration to both slots
+ *
+ * @return _SUCCESS once the primary slot is written
+ */
+int config_store_save(const device_config_t *cfg);
+
+const char *config_origin_name(config_origin_t origin);
+
+#endif
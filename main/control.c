@@ -26,9 +26,8 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
-#include "esp_system.h"
-#include "esp_log.h"
+#include <assert.h>
+#include "platform.h"
 #include "control.h"
 #include "login.h"
 #include "config.h"
@@ -37,45 +36,73 @@
 #include "sntp.h"
 #include "tcpmux.h"
 #include "timer.h"
-#include "lwip/err.h"
-#include "lwip/sockets.h"
-#include "lwip/sys.h"
-#include <lwip/netdb.h>
+#include "reactor.h"
+#include "heartbeat.h"
+#include "boottrace.h"
+#include "memplan.h"
+#ifdef ESP_PLATFORM
 #include "driver/gpio.h"
+#endif
 
 // GPIO configuration is now defined in config.h
 
 static const char *TAG = "control";
 
 // Global variables
-char g_RxBuffer[2048];        // Receive data buffer
-char g_IsLogged = 0;          // Login status flag
-char g_ProxyWork = 0;         // Proxy service activation flag
+static char *g_RxBuffer;      // Receive data buffer, RX_BUFFER_SIZE bytes of the tunnel arena
 uint g_session_id = 1;        // Session ID counter
-uint linked = 0;              // Connection established flag
 
 Control_t *g_pMainCtl;        // Main control structure
 ProxyService_t *g_pProxyService;
-ProxyClient_t *g_pClient;
-time_t g_Pongtime = 0;
-char client_connected = 0;     // Client connection status
+static ProxyClient_t *g_clients;  // Work connection pool in the tunnel arena, indexed by PROXY_CLIENT_SLOT()
+static tmux_reader_t g_Reader;  // Frame parser for the main socket
+static uint32_t g_stalled_stream = 0;   // Stream whose full local buffer holds back the reader, 0 if none
+static reactor_timer_t g_stall_timer;   // Gives up on that stream after LOCAL_SEND_TIMEOUT_MS
+static uchar *g_CtlMsg;  // Control message (or frps IV) being assembled, CTL_MSG_MAX + 1 bytes of the tunnel arena
+static uint g_CtlLen = 0;                // Bytes of it received so far
+
+static uint32_t g_lost_ms = 0;                        // Time the last session was lost, 0 while connected
+static uint32_t g_reconnect_ms[RECONNECT_SAMPLES];    // Ring of recent reconnect latencies
+static uint32_t g_reconnect_count = 0;
+static uint32_t g_ready_ms[READY_SAMPLES];            // Ring of recent connect to proxy registered latencies
+static uint32_t g_ready_count = 0;
+static uint32_t g_boot_login_ms = 0;                  // Boot to first Login sent, 0 before
 
 // External declarations
 extern struct frp_coder *decoder;
 extern login_t *g_pLogin;
+extern MainConfig_t *g_pMainConf;
 extern struct frp_coder *encoder;
 extern Control_t *g_pMainCtl;
 
 // 连接状态控制函数声明 (定义在timer.c中)
 extern void set_frpc_connection_connected(void);
+extern void set_frpc_connection_lost(void);
 extern void set_frpc_connection_disconnected(void);
 
 // GPIO initialization is now handled in main.c
 
+static void on_main_event(int fd, int events, void *arg);
+static void on_local_event(int fd, int events, void *arg);
+static void on_connect_timeout(void *arg);
+
 /**
- * Establish connection to the remote server
+ * Flag the current session as broken
+ * Called by any send/receive path that hits a socket error; the supervisor
+ * in connect_to_server() tears the session down and reconnects.
  */
-void connect_to_server() {
+void mark_session_broken() {
+    if (g_pMainCtl && !g_pMainCtl->iSessionErr) {
+        ESP_LOGE(TAG, "session broken: errno %d", errno);
+        g_pMainCtl->iSessionErr = 1;
+    }
+}
+
+/**
+ * Open the TCP connection to frps
+ * @return Connected socket, -1 on failure
+ */
+static int open_main_connection() {
     char addr_str[128];
     int addr_family;
     int ip_protocol;
@@ -89,31 +116,195 @@ void connect_to_server() {
     ip_protocol = IPPROTO_IP;
     inet_ntoa_r(destAddr.sin_addr, addr_str, sizeof(addr_str) - 1);
 
-    // Timer is already initialized in main.c
-
     int MainSock = socket(addr_family, SOCK_STREAM, ip_protocol);
     if (MainSock < 0) {
         ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
-        return;
+        return -1;
     }
     ESP_LOGI(TAG, "Socket created");
 
     err = connect(MainSock, (struct sockaddr *)&destAddr, sizeof(destAddr));
     if (err != 0) {
-        ESP_LOGE(TAG, "Socket unable to connect: errno %d", errno);
+        ESP_LOGE(TAG, "Socket unable to connect to %s: errno %d", addr_str, errno);
         close(MainSock);
-        RESET_DEVICE;  // 异常断开直接重启，不需要LED闪烁
-        return;
+        return -1;
     }
 
-    g_pMainCtl->iMainSock = MainSock;
     ESP_LOGI(TAG, "Successfully connected");
+    return MainSock;
+}
 
-    send_window_update(MainSock, &g_pMainCtl->stream, 0);  // window update
-    login(MainSock);  // Perform login procedure
-    
-    while (1) {  // Main processing loop
-        process_data();
+/**
+ * Tear down the control session: socket, work connections, framing and
+ * cipher state. WiFi and the derived key are kept.
+ */
+static void close_session() {
+    for (int i = 0; i < MAX_PROXY_CLIENTS; i++) {
+        if (g_clients[i].in_use) {
+            free_proxy_client(&g_clients[i]);
+        }
+    }
+    if (g_pMainCtl->iMainSock >= 0) {
+        reactor_del(g_pMainCtl->iMainSock);
+        close(g_pMainCtl->iMainSock);
+    }
+    g_pMainCtl->iMainSock = -1;
+    g_pMainCtl->iSessionErr = 0;
+    g_session_id = 1;
+    tmux_stream_init(&g_pMainCtl->stream, g_session_id);
+    tmux_reader_init(&g_Reader);
+    g_stalled_stream = 0;
+    reactor_timer_stop(&g_stall_timer);
+    g_CtlLen = 0;
+    crypto_reset_coders();     // Next session exchanges fresh IVs
+    g_pMainCtl->state = SESSION_IDLE;
+    heartbeat_stop();
+    set_frpc_connection_lost();
+    reactor_dump_stats();
+    heartbeat_dump_stats();
+}
+
+/**
+ * Record how long it took to get a session back after a loss
+ * @param latency_ms Loss to proxy registered interval
+ */
+static void record_reconnect(uint32_t latency_ms) {
+    g_reconnect_ms[g_reconnect_count % RECONNECT_SAMPLES] = latency_ms;
+    g_reconnect_count++;
+    ESP_LOGI(TAG, "reconnected in %u ms", latency_ms);
+}
+
+/**
+ * Record how long a session took from connect() to a registered proxy
+ * @param latency_ms Connect to NewProxyResp interval
+ */
+static void record_ready(uint32_t latency_ms) {
+    g_ready_ms[g_ready_count % READY_SAMPLES] = latency_ms;
+    g_ready_count++;
+    ESP_LOGI(TAG, "proxy registered %u ms after connect", latency_ms);
+}
+
+/**
+ * Compute percentiles over a ring of latency samples
+ * @param samples Sample ring
+ * @param count Samples recorded since boot
+ * @param window Ring capacity, at most 32
+ * @param stats Output statistics, all zero before the first sample
+ */
+static void latency_percentiles(const uint32_t *samples, uint32_t count, uint32_t window, latency_stats_t *stats) {
+    uint32_t sorted[32];
+    uint32_t n = count < window ? count : window;
+
+    memset(stats, 0, sizeof(latency_stats_t));
+    stats->count = count;
+    if (0 == n) {
+        return;
+    }
+
+    // Insertion sort, the sample window is tiny
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t v = samples[i];
+        uint32_t k = i;
+        while (k > 0 && sorted[k - 1] > v) {
+            sorted[k] = sorted[k - 1];
+            k--;
+        }
+        sorted[k] = v;
+    }
+
+    stats->p50_ms = sorted[(n - 1) * 50 / 100];
+    stats->p90_ms = sorted[(n - 1) * 90 / 100];
+    stats->p99_ms = sorted[(n - 1) * 99 / 100];
+    stats->max_ms = sorted[n - 1];
+}
+
+/**
+ * Get reconnect latency statistics over the last RECONNECT_SAMPLES reconnects
+ * @param stats Output statistics, all zero before the first reconnect
+ */
+void get_reconnect_stats(latency_stats_t *stats) {
+    latency_percentiles(g_reconnect_ms, g_reconnect_count, RECONNECT_SAMPLES, stats);
+}
+
+/**
+ * Get time-to-ready statistics over the last READY_SAMPLES sessions
+ * Measured from connect() to frps accepting NewProxy, boot and reconnects alike.
+ * @param stats Output statistics, all zero before the first registered proxy
+ */
+void get_ready_stats(latency_stats_t *stats) {
+    latency_percentiles(g_ready_ms, g_ready_count, READY_SAMPLES, stats);
+}
+
+/**
+ * Get the time from boot to the first Login sent
+ * @return Milliseconds, 0 before the first login
+ */
+uint32_t get_boot_to_login_ms() {
+    return g_boot_login_ms;
+}
+
+/**
+ * Establish connection to the remote server
+ * Supervises the control session: on any socket error the session is torn
+ * down and login is retried with exponential backoff and jitter, instead
+ * of rebooting the device.
+ */
+void connect_to_server() {
+    uint32_t backoff_ms = RECONNECT_BACKOFF_MIN_MS;
+
+    while (1) {
+        if (!clock_valid()) {  // The auth key needs wall time, don't connect without it
+            ESP_LOGI(TAG, "waiting for valid time before login");
+            reactor_run_once(CLOCK_WAIT_POLL_MS);  // Lets the SNTP replies in
+            continue;
+        }
+        boot_mark(BOOT_CLOCK);
+
+        g_pMainCtl->start_ms = plat_now_ms();
+        int MainSock = open_main_connection();
+
+        if (MainSock >= 0) {
+            boot_mark(BOOT_TCP_CONNECTED);
+            g_pMainCtl->iMainSock = MainSock;
+            reactor_add(MainSock, REACTOR_READ, on_main_event, NULL);
+            heartbeat_start(MainSock, g_pMainConf->heartbeat_interval, g_pMainConf->heartbeat_timeout);
+            send_window_update(MainSock, &g_pMainCtl->stream, 0);  // window update
+            g_pMainCtl->state = SESSION_LOGIN_SENT;
+            if (_SUCCESS != login(MainSock)) {  // Perform login procedure
+                mark_session_broken();
+            } else if (0 == g_boot_login_ms) {
+                clock_stats_t cs;
+                clock_get_stats(&cs);
+                g_boot_login_ms = plat_now_ms() | 1;
+                ESP_LOGI(TAG, "boot to login %u ms, time from %s", g_boot_login_ms, clock_source_name(cs.source));
+            }
+
+            // The rest of the handshake is driven by handle_control_msg()
+            while (!g_pMainCtl->iSessionErr) {  // Main processing loop
+                process_data();
+                if (SESSION_READY == g_pMainCtl->state) {
+                    backoff_ms = RECONNECT_BACKOFF_MIN_MS;  // Session is healthy again
+                }
+            }
+            close_session();
+        }
+
+        if (0 == g_lost_ms) {
+            g_lost_ms = plat_now_ms() | 1;  // Never 0, that means connected
+        }
+
+        // Full jitter over the upper half of the backoff window
+        uint32_t delay_ms = backoff_ms / 2 + plat_random() % (backoff_ms / 2 + 1);
+        uint32_t deadline_ms = plat_now_ms() + delay_ms;
+        ESP_LOGI(TAG, "reconnecting in %u ms", delay_ms);
+        for (int32_t left_ms; (left_ms = (int32_t)(deadline_ms - plat_now_ms())) > 0; ) {
+            reactor_run_once(left_ms);  // SNTP and clock timers keep running
+        }
+
+        backoff_ms *= 2;
+        if (backoff_ms > RECONNECT_BACKOFF_MAX_MS) {
+            backoff_ms = RECONNECT_BACKOFF_MAX_MS;
+        }
     }
 }
 
@@ -125,6 +316,7 @@ void initialize() {
     init_login();            // Initialize login
     init_main_control();     // Setup main control structure
     init_main_config();      // Load main configuration
+    crypto_init_key(g_pMainConf->auth_token);  // Derive the AES key once per token
     init_proxy_Service();    // Configure proxy service
     init_sntp();             // Initialize SNTP for time sync
     set_frpc_connection_disconnected();  // Initial state - NET LED off
@@ -135,6 +327,15 @@ void initialize() {
  * @return _SUCCESS on success, _FAIL otherwise
  */
 int init_main_control() {    
+    tunnel_mem_t *mem = mem_tunnel();
+    if (NULL == mem) {
+        ESP_LOGE(TAG, "error: tunnel buffers not planned!");
+        return _FAIL;
+    }
+    g_RxBuffer = mem->rx;
+    g_CtlMsg = mem->ctl_msg;
+    g_clients = mem->clients;
+
     if (g_pMainCtl && g_pMainCtl->iMainSock) {
         ESP_LOGE(TAG, "error: main control or base socket already exists!");
         close(g_pMainCtl->iMainSock);
@@ -149,8 +350,9 @@ int init_main_control() {
     }  
     
     g_pMainCtl->iMainSock = -1;
-    g_pMainCtl->stream.id = g_session_id;  // Set session ID
-    g_pMainCtl->stream.state = INIT;       // Initial stream state
+    g_pMainCtl->iSessionErr = 0;
+    g_pMainCtl->state = SESSION_IDLE;
+    tmux_stream_init(&g_pMainCtl->stream, g_session_id);  // Set session ID and initial windows
 
     return _SUCCESS;
 }
@@ -178,35 +380,35 @@ void init_proxy_Service() {
 /**
  * Perform login procedure
  * @param Sockfd Socket descriptor
- * @return _SUCCESS on success
+ * @return _SUCCESS on success, _FAIL otherwise
  */
 int login(int Sockfd) {
-    char *lg_msg = NULL;
-    uint len = login_request_marshal(&lg_msg);  // Marshal login request
-    
+    size_t cap;
+    char *lg_msg = msg_tx_begin(&cap);
     if (!lg_msg) {
-        ESP_LOGE(TAG, "error: login_request_marshal failed");
-        exit(0);
+        return _FAIL;
     }
-    
-    send_msg_frp_server(Sockfd, TypeLogin, lg_msg, len, &g_pMainCtl->stream);
+
+    uint len = login_request_marshal(lg_msg, cap);  // Encoded straight into the transmit arena
+    int ret = msg_tx_commit(Sockfd, TypeLogin, len, &g_pMainCtl->stream, 0);
     ESP_LOGI(TAG, "info: end login procedure");
-    
-    SAFE_FREE(lg_msg);  // Free allocated message buffer
-    return _SUCCESS;
+    return ret;
 }
 
 /**
- * Write data to TCP multiplexing stream
+ * Write a gather list to TCP multiplexing stream as a single DATA frame
+ * The frame is all-or-nothing: nothing is sent unless the peer's window
+ * can take every byte.
  * @param Sockfd Socket descriptor
- * @param data Data buffer to send
- * @param length Data length
+ * @param iov Payload gather list, slot 0 is reserved for the tcp mux header
+ * @param iovcnt Number of entries including the header slot
  * @param pstream Stream context
- * @return _SUCCESS on success, _FAIL otherwise
+ * @return Number of payload bytes sent (0 when closed or out of credit), -1 on socket error
  */
-uint tmux_stream_write(int Sockfd, char *data, uint length, tmux_stream_t *pstream) {
-    uint uiRet = _SUCCESS;
-        
+int tmux_stream_writev(int Sockfd, struct iovec *iov, int iovcnt, tmux_stream_t *pstream) {
+    tcp_mux_header_t tmux_hdr;
+    uint length = 0;
+
     switch(pstream->state) {
     case LOCAL_CLOSE:
     case CLOSED:
@@ -217,60 +419,178 @@ uint tmux_stream_write(int Sockfd, char *data, uint length, tmux_stream_t *pstre
         break;
     }
 
+    for (int i = 1; i < iovcnt; i++) {
+        length += iov[i].iov_len;
+    }
+    if (0 == length) {
+        return 0;
+    }
+    if (length > pstream->send_window) {
+        ESP_LOGI(TAG, "stream %u window exhausted: %u of %u bytes fit", pstream->id, pstream->send_window, length);
+        return 0;
+    }
+
     ushort flags = get_send_flags(pstream);  // Get protocol flags
     ESP_LOGI(TAG, "tmux_stream_write stream id %u  length %u", pstream->id, length);
 
-    tcp_mux_send_hdr(Sockfd, flags, pstream->id, length);  // Send header
-    if (send(Sockfd, data, length, 0) < 0) {               // Send payload
+    tcp_mux_encode(DATA, flags, pstream->id, length, &tmux_hdr);
+    iov[0].iov_base = &tmux_hdr;
+    iov[0].iov_len = sizeof(tmux_hdr);
+
+    if (tcp_mux_sendv(Sockfd, iov, iovcnt) != _SUCCESS) {  // Header and payload in one segment
         ESP_LOGE(TAG, "error: tmux_stream_write send FAIL");
-        uiRet = _FAIL;
-        RESET_DEVICE;  // 异常断开直接重启，不需要LED闪烁
-    }   
-    return uiRet;
+        mark_session_broken();
+        return -1;
+    }
+    pstream->send_window -= length;
+    return length;
+}
+
+/**
+ * Write data to TCP multiplexing stream
+ * Never sends more than the peer's remaining window; the caller keeps
+ * whatever was not accepted and retries after a window update.
+ * @param Sockfd Socket descriptor
+ * @param data Data buffer to send
+ * @param length Data length
+ * @param pstream Stream context
+ * @return Number of bytes sent (0 when closed or out of credit), -1 on socket error
+ */
+int tmux_stream_write(int Sockfd, char *data, uint length, tmux_stream_t *pstream) {
+    struct iovec iov[2];
+
+    if (length > pstream->send_window) {
+        length = pstream->send_window;
+    }
+    iov[1].iov_base = data;
+    iov[1].iov_len = length;
+    return tmux_stream_writev(Sockfd, iov, 2, pstream);
 }
 
 /**
  * Start proxy services by sending configuration to server
+ * The first encrypted message, so our IV travels in the same frame.
  */
 void start_proxy_services() {
     ProxyService_t *ps = g_pProxyService;
-    
-    char *new_proxy_msg = NULL;
-    int len = new_proxy_service_marshal(ps, &new_proxy_msg);  // Marshal proxy config
+    size_t cap;
+
+    char *new_proxy_msg = msg_tx_begin(&cap);
     if (!new_proxy_msg) {
-        ESP_LOGI(TAG, "proxy service request marshal failed");
         return;
     }
+    int len = new_proxy_service_marshal(ps, new_proxy_msg, cap);  // Marshal proxy config
 
     ESP_LOGI(TAG, "control proxy client: [Type %d : proxy_name %s : msg_len %d]", 
              TypeNewProxy, ps->proxy_name, len);
     
-    send_enc_msg_frp_server(g_pMainCtl->iMainSock, TypeNewProxy, new_proxy_msg, len, &g_pMainCtl->stream);
-    SAFE_FREE(new_proxy_msg);  // Free message buffer
+    msg_tx_commit(g_pMainCtl->iMainSock, TypeNewProxy, len, &g_pMainCtl->stream, 1);
 }
 
 /**
  * Create new proxy client instance
- * @return Initialized proxy client structure
+ * Takes the next stream ID whose slot in the client table is free.
+ * @return Initialized proxy client structure, NULL if the table is full
  */
 ProxyClient_t *new_proxy_client() {
-    g_session_id += 2;  // Increment session ID
-    ProxyClient_t *client = calloc(1, sizeof(ProxyClient_t));
-    client->stream_id = g_session_id;       // Assign stream ID
-    client->iMainSock = g_pMainCtl->iMainSock;  // Share main socket
-    client->stream.id = g_session_id;       // Set stream ID
-    client->stream.state = INIT;            // Initial stream state
-    return client;
+    for (int i = 0; i < MAX_PROXY_CLIENTS; i++) {
+        g_session_id += 2;  // Increment session ID
+        ProxyClient_t *client = &g_clients[PROXY_CLIENT_SLOT(g_session_id)];
+        if (client->in_use) {
+            continue;       // Slot still serving an older stream, skip this ID
+        }
+
+        memset(client, 0, sizeof(ProxyClient_t));
+        client->in_use = 1;
+        client->stream_id = g_session_id;       // Assign stream ID
+        client->iMainSock = g_pMainCtl->iMainSock;  // Share main socket
+        client->iLocalSock = -1;
+        client->ps = g_pProxyService;
+        tmux_stream_init(&client->stream, g_session_id);  // Set stream ID and initial windows
+        return client;
+    }
+    return NULL;
+}
+
+/**
+ * Look up the proxy client owning a stream
+ * @param stream_id Stream ID from the tcp mux header
+ * @return Proxy client, NULL if no live client owns the stream
+ */
+ProxyClient_t *get_proxy_client(uint32_t stream_id) {
+    ProxyClient_t *client = &g_clients[PROXY_CLIENT_SLOT(stream_id)];
+    if (client->in_use && client->stream_id == stream_id) {
+        return client;
+    }
+    return NULL;
+}
+
+/**
+ * Release a proxy client slot back to the pool
+ * @param client Proxy client to release
+ */
+void free_proxy_client(ProxyClient_t *client) {
+    ESP_LOGI(TAG, "free client stream %u", client->stream_id);
+    reactor_timer_stop(&client->connect_timer);
+    if (client->iLocalSock >= 0) {
+        reactor_del(client->iLocalSock);
+        close(client->iLocalSock);
+    }
+    memset(client, 0, sizeof(ProxyClient_t));
+    client->iLocalSock = -1;
+
+    // NET LED blinks once no work connection is left
+    for (int i = 0; i < MAX_PROXY_CLIENTS; i++) {
+        if (g_clients[i].in_use && g_clients[i].work_started) {
+            return;
+        }
+    }
+    set_frpc_connection_lost();
 }
 
 /**
  * Handle new client connection through TCP multiplexer
  */
 void new_client_connect() {
-    g_pClient = new_proxy_client();  // Create client instance
-    ESP_LOGI(TAG, "new client through tcp mux: %d", g_pClient->stream_id);
-    send_window_update(g_pClient->iMainSock, &g_pClient->stream, 0);  // window Update
-    new_work_connection(g_pMainCtl->iMainSock, &g_pClient->stream);   // Establish work connection
+    ProxyClient_t *client = new_proxy_client();  // Create client instance
+    if (NULL == client) {
+        ESP_LOGE(TAG, "error: client table full, work connection dropped");
+        return;
+    }
+    ESP_LOGI(TAG, "new client through tcp mux: %d", client->stream_id);
+    send_window_update(client->iMainSock, &client->stream, 0);  // window Update
+    new_work_connection(g_pMainCtl->iMainSock, &client->stream);   // Establish work connection
+}
+
+/**
+ * Count work connections registered with frps and still waiting for a visitor
+ * @return Number of idle pooled work connections
+ */
+static int idle_work_conns() {
+    int idle = 0;
+    for (int i = 0; i < MAX_PROXY_CLIENTS; i++) {
+        if (g_clients[i].in_use && !g_clients[i].work_started) {
+            idle++;
+        }
+    }
+    return idle;
+}
+
+/**
+ * Top the work connection pool back up to pool_count
+ * Called as soon as a visitor takes a pooled connection, so the next
+ * visitor does not wait for frps's ReqWorkConn round trip.
+ */
+static void replenish_pool() {
+    while (idle_work_conns() < g_pLogin->pool_count) {
+        ProxyClient_t *client = new_proxy_client();
+        if (NULL == client) {
+            return;  // Table busy with visitors, frps will ask again
+        }
+        ESP_LOGI(TAG, "pool: new work connection %u", client->stream_id);
+        send_window_update(client->iMainSock, &client->stream, 0);
+        new_work_connection(client->iMainSock, &client->stream);
+    }
 }
 
 /**
@@ -281,171 +601,691 @@ void new_client_connect() {
 void new_work_connection(int iSock, struct tmux_stream *stream) {
     assert(iSock);
     
-    struct work_conn *work_c = calloc(1, sizeof(struct work_conn));
-    work_c->run_id = g_pLogin->run_id;  // Get run ID from login context
-    if (!work_c->run_id) {
+    struct work_conn work_c;
+    work_c.run_id = g_pLogin->run_id;  // Get run ID from login context
+    if (!work_c.run_id) {
         ESP_LOGI(TAG, "cannot found run ID");
-        SAFE_FREE(work_c);
         return;
     }
     
-    char *new_work_conn_request_message = NULL;
-    int nret = new_work_conn_marshal(work_c, &new_work_conn_request_message);
-    if (0 == nret) {
-        ESP_LOGI(TAG, "new work connection request marshal failed!");
+    size_t cap;
+    char *new_work_conn_request_message = msg_tx_begin(&cap);
+    if (!new_work_conn_request_message) {
+        return;
+    }
+    int nret = new_work_conn_marshal(&work_c, new_work_conn_request_message, cap);
+
+    msg_tx_commit(iSock, TypeNewWorkConn, nret, stream, 0);
+}
+
+/**
+ * Move the session on once frps has accepted the login
+ * Our encrypted stream gets its own IV, so NewProxy goes out right away
+ * instead of waiting for frps's IV and first ReqWorkConn.
+ */
+static void on_logged_in() {
+    uint8_t iv[AES_128_IV_SIZE];
+
+    g_pMainCtl->state = SESSION_LOGGED_IN;
+    boot_mark(BOOT_LOGIN_RESP);
+    for (int i = 0; i < AES_128_IV_SIZE; i += sizeof(uint32_t)) {
+        uint32_t r = plat_random();
+        memcpy(iv + i, &r, sizeof(r));
+    }
+    if (NULL == init_encoder(iv)) {
+        mark_session_broken();
         return;
     }
+    start_proxy_services();  // IV + NewProxy
+}
+
+/**
+ * Handle frps's answer to NewProxy
+ * @param mhdr Decoded message
+ * @param len Message length including msg_hdr
+ */
+static void on_new_proxy_resp(struct msg_hdr *mhdr, uint len) {
+    struct new_proxy_resp npr;
 
-    send_msg_frp_server(iSock, TypeNewWorkConn, new_work_conn_request_message, nret, stream);
+    if (_SUCCESS != new_proxy_resp_unmarshal(mhdr->data, len - sizeof(struct msg_hdr), &npr)) {
+        ESP_LOGE(TAG, "error: malformed NewProxyResp");
+        mark_session_broken();
+        return;
+    }
+    if ('\0' != npr.error[0]) {
+        ESP_LOGE(TAG, "error: proxy %s rejected: %s", g_pProxyService->proxy_name, npr.error);
+        mark_session_broken();  // Retry the whole session with backoff
+        return;
+    }
+    ESP_LOGI(TAG, "proxy %s listening on frps %s", npr.proxy_name, npr.remote_addr);
+    if (SESSION_READY == g_pMainCtl->state) {
+        return;
+    }
 
-    SAFE_FREE(new_work_conn_request_message);
-    SAFE_FREE(work_c);
+    g_pMainCtl->state = SESSION_READY;
+    boot_mark(BOOT_NEW_PROXY_RESP);
+    record_ready(plat_now_ms() - g_pMainCtl->start_ms);
+    if (g_lost_ms) {
+        record_reconnect(plat_now_ms() - g_lost_ms);
+        g_lost_ms = 0;
+    }
 }
 
 /**
- * Process incoming data from server
+ * Handle a message received on the main control stream
+ * After LoginResp, messages are accepted in whatever order frps sends them.
+ * @param mhdr Decoded message, NUL terminated
+ * @param len Message length including msg_hdr
  */
-void process_data() {
-    struct tcp_mux_header tmux_hdr;
-    uint uiHdrLen;
-    uint stream_len;
-    uint16_t flags;
-    int MainSock = g_pMainCtl->iMainSock;
-    int streamId;
-    int rx_len;
-    size_t pt_len;
-    struct msg_hdr* mhdr;
-    uchar *decrypted = NULL;
-    tmux_stream_t cur_stream;
+static void handle_control_msg(struct msg_hdr *mhdr, uint len) {
+    ESP_LOGI(TAG, "type: %c", mhdr->type);
+    ESP_LOGI(TAG, "data: %s", mhdr->data);
+
+    if (SESSION_LOGIN_SENT == g_pMainCtl->state) {  // Only LoginResp can come first
+        if (TypeLoginResp != mhdr->type || _SUCCESS != handle_login_response((char*)mhdr, len)) {
+            mark_session_broken();
+            return;
+        }
+        on_logged_in();
+        return;
+    }
+
+    switch (mhdr->type) {
+    case TypeReqWorkConn:  // Work conn request
+        ESP_LOGI(TAG, "mhdr->type == TypeReqWorkConn");
+        // frps asks again after every visitor; a proactive refill may already cover it
+        if (idle_work_conns() < g_pLogin->pool_count) {
+            new_client_connect();  // Create client connection
+        }
+        break;
+    case TypeNewProxyResp:  // Proxy response
+        ESP_LOGI(TAG, "mhdr->type == TypeNewProxyResp");
+        on_new_proxy_resp(mhdr, len);
+        break;
+    case TypePong:  // Keep-alive response
+        heartbeat_pong();
+        ESP_LOGI(TAG, "msg->type: TypePong");
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * Add control stream bytes to the message being assembled
+ * Dispatches the message once its msg_hdr and body are complete.
+ * @param data Plaintext bytes
+ * @param len Number of bytes available
+ * @return Number of bytes taken
+ */
+static uint ctl_collect(const uchar *data, uint len) {
+    struct msg_hdr *mhdr = (struct msg_hdr *)g_CtlMsg;
+    uint want = sizeof(struct msg_hdr);
+
+    if (g_CtlLen >= sizeof(struct msg_hdr)) {
+        uint64_t body = ntoh64(mhdr->length);
+        if (body > CTL_MSG_MAX - sizeof(struct msg_hdr)) {
+            ESP_LOGE(TAG, "error: control msg %c of %u bytes too large", mhdr->type, (uint)body);
+            mark_session_broken();  // Cannot resync the stream, start over
+            return len;
+        }
+        want += (uint)body;
+    }
+
+    uint n = want - g_CtlLen < len ? want - g_CtlLen : len;
+    memcpy(g_CtlMsg + g_CtlLen, data, n);
+    g_CtlLen += n;
+
+    if (g_CtlLen == want && (want > sizeof(struct msg_hdr) || 0 == mhdr->length)) {
+        g_CtlMsg[want] = '\0';
+        g_CtlLen = 0;
+        handle_control_msg(mhdr, want);
+    }
+    return n;
+}
+
+/**
+ * Parse a chunk of the main control stream
+ * The stream is the plain LoginResp, then frps's raw IV, then encrypted
+ * messages. Boundaries may fall anywhere, so LoginResp, the IV and the
+ * first messages can share one frame.
+ * @param data Chunk, decrypted in place
+ * @param len Chunk length
+ */
+static void feed_control(uchar *data, uint len) {
+    uint n;
+    int err;
+
+    while (len > 0 && SESSION_LOGIN_SENT == g_pMainCtl->state && !g_pMainCtl->iSessionErr) {
+        n = ctl_collect(data, len);
+        data += n;
+        len -= n;
+    }
+    if (g_pMainCtl->iSessionErr || SESSION_IDLE == g_pMainCtl->state) {
+        return;
+    }
+
+    if (len > 0 && NULL == decoder) {  // frps's IV
+        n = AES_128_IV_SIZE - g_CtlLen < len ? AES_128_IV_SIZE - g_CtlLen : len;
+        memcpy(g_CtlMsg + g_CtlLen, data, n);
+        g_CtlLen += n;
+        data += n;
+        len -= n;
+        if (AES_128_IV_SIZE == g_CtlLen) {
+            g_CtlLen = 0;
+            if (NULL == init_decoder(g_CtlMsg)) {
+                mark_session_broken();
+                return;
+            }
+            boot_mark(BOOT_IV);
+        }
+    }
+    if (0 == len || NULL == decoder) {
+        return;
+    }
+
+    // CFB keeps its position across calls, so chunks decrypt as they come
+    err = my_aes_decrypt_stream(data, len);
+    if (0 != err) {
+        ESP_LOGE(TAG, "error: control stream decryption failed: -0x%x", -err);
+        mark_session_broken();  // Parsing ciphertext as messages would only desync further
+        return;
+    }
+    while (len > 0 && !g_pMainCtl->iSessionErr) {
+        n = ctl_collect(data, len);
+        data += n;
+        len -= n;
+    }
+}
+
+/**
+ * Abort a work connection: reset its stream and release the slot
+ * @param client Proxy client to abort
+ */
+static void abort_proxy_client(ProxyClient_t *client) {
+    send_stream_reset(client->iMainSock, &client->stream);
+    free_proxy_client(client);
+}
+
+/**
+ * Start serving a work connection after StartWorkConn
+ * The local service is connected without blocking; the connect completes
+ * in process_data(). local_port 0 selects the on-device relay command
+ * handler instead; any other address, loopback included, is connected.
+ * @param client Proxy client
+ */
+static void start_local_service(ProxyClient_t *client) {
+    ProxyService_t *ps = client->ps;
+    struct sockaddr_in destAddr;
+
+    memset(&destAddr, 0, sizeof(destAddr));
+    destAddr.sin_addr.s_addr = inet_addr(ps->local_ip);
+    destAddr.sin_family = AF_INET;
+    destAddr.sin_port = htons(ps->local_port);
+
+    if (0 == ps->local_port) {
+        client->builtin = 1;  // The device itself is the local service
+        return;
+    }
+
+    int LocalSock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if (LocalSock < 0) {
+        ESP_LOGE(TAG, "Unable to create local socket: errno %d", errno);
+        abort_proxy_client(client);
+        return;
+    }
+    fcntl(LocalSock, F_SETFL, fcntl(LocalSock, F_GETFL, 0) | O_NONBLOCK);
+
+    client->iLocalSock = LocalSock;
+    if (_SUCCESS != reactor_add(LocalSock, REACTOR_WRITE, on_local_event, client)) {
+        abort_proxy_client(client);
+        return;
+    }
+    if (0 == connect(LocalSock, (struct sockaddr *)&destAddr, sizeof(destAddr))) {
+        client->connected = 1;
+    } else if (EINPROGRESS != errno) {
+        ESP_LOGE(TAG, "stream %u: local connect to %s:%d failed: errno %d",
+                 client->stream_id, ps->local_ip, ps->local_port, errno);
+        abort_proxy_client(client);
+        return;
+    }
+    if (!client->connected) {
+        reactor_timer_start(&client->connect_timer, LOCAL_CONNECT_TIMEOUT_MS, on_connect_timeout, client);
+    }
+    ESP_LOGI(TAG, "stream %u: forwarding to %s:%d", client->stream_id, ps->local_ip, ps->local_port);
+}
+
+/**
+ * Serve stream data with the built-in relay command handler
+ * Besides POWER_ON/POWER_OFF, BOOT_TRACE answers with the boot timeline.
+ * Data must be NUL terminated.
+ * @param client Proxy client
+ * @param data Received data
+ * @param len Data length
+ */
+static void handle_builtin_data(ProxyClient_t *client, char *data, uint len) {
+    ESP_LOGD(TAG, "builtin stream %u: %u bytes [%.*s]", client->stream.id, len, (int)(len < 64 ? len : 64), data);
+
+    // Send acknowledgment
+    char buf[32] = {0};
+    snprintf(buf, sizeof(buf), "%u bytes recieved!\n", len);
+    tmux_stream_write(g_pMainCtl->iMainSock, buf, strlen(buf), &client->stream);
     
-    memset(&tmux_hdr, 0, sizeof(tmux_hdr));
-    uiHdrLen = read(MainSock, &tmux_hdr, sizeof(tmux_hdr));  // Read header
+    // Boot timeline for startup latency work
+    if(strstr(data, "BOOT_TRACE")) {
+        static char trace[768];
+        size_t n = boot_trace_format(trace, sizeof(trace));
+        tmux_stream_write(g_pMainCtl->iMainSock, trace, n, &client->stream);
+    }
+
+    // GPIO control logic (LED and Relay control)
+    if(strstr(data, "POWER_ON")) {
+        plat_gpio_set(POWER_LED, 0);    // Turn ON power LED (active-low)
+        plat_gpio_set(RELAY, 1);        // Turn ON relay
+        ESP_LOGI(TAG, "POWER_ON command received - LED and Relay activated");
+    }
+    if(strstr(data, "POWER_OFF")) {
+        plat_gpio_set(POWER_LED, 1);    // Turn OFF power LED (active-low)
+        plat_gpio_set(RELAY, 0);        // Turn OFF relay
+        ESP_LOGI(TAG, "POWER_OFF command received - LED and Relay deactivated");
+    }
+}
 
-    if (uiHdrLen < sizeof(tmux_hdr)) {
-        ESP_LOGI(TAG, "uiHdrLen [%d] < sizeof tmux_hdr", uiHdrLen);
-        RESET_DEVICE;
+/**
+ * Push buffered stream data to the local socket without blocking
+ * Window credit goes back to frps only for bytes the local service took,
+ * which is what throttles a fast visitor in front of a slow service.
+ * @param client Proxy client
+ * @return _SUCCESS, or _FAIL after the client has been aborted
+ */
+static int flush_to_local(ProxyClient_t *client) {
+    if (!client->connected || 0 == client->to_local_len) {
+        return _SUCCESS;
+    }
+
+    int n = send(client->iLocalSock, client->to_local, client->to_local_len, 0);
+    if (n < 0) {
+        if (EAGAIN == errno || EWOULDBLOCK == errno) {
+            return _SUCCESS;
+        }
+        ESP_LOGE(TAG, "stream %u: local send failed: errno %d", client->stream_id, errno);
+        abort_proxy_client(client);
+        return _FAIL;
+    }
+
+    client->to_local_len -= n;
+    memmove(client->to_local, client->to_local + n, client->to_local_len);
+    tmux_stream_consumed(client->iMainSock, &client->stream, n);
+    return _SUCCESS;
+}
+
+/**
+ * Handle the local socket becoming writable: finish a pending connect,
+ * then flush buffered stream data; a stream frps already closed is closed
+ * here once the local service has taken the rest of its data
+ * @param client Proxy client
+ * @return _SUCCESS, or _FAIL after the client has been aborted or released
+ */
+static int local_writable(ProxyClient_t *client) {
+    if (!client->connected) {
+        int err = 0;
+        socklen_t optlen = sizeof(err);
+        getsockopt(client->iLocalSock, SOL_SOCKET, SO_ERROR, &err, &optlen);
+        if (err) {
+            ESP_LOGE(TAG, "stream %u: local connect failed: errno %d", client->stream_id, err);
+            abort_proxy_client(client);
+            return _FAIL;
+        }
+        client->connected = 1;
+        reactor_timer_stop(&client->connect_timer);
+    }
+    if (_SUCCESS != flush_to_local(client)) {
+        return _FAIL;
+    }
+    if (0 == client->to_local_len && REMOTE_CLOSE == client->stream.state) {
+        send_stream_close(client->iMainSock, &client->stream);
+        free_proxy_client(client);
+        return _FAIL;
+    }
+    return _SUCCESS;
+}
+
+/**
+ * Deliver stream data to the local service
+ * @param client Proxy client
+ * @param data Received data (NUL terminated)
+ * @param len Data length
+ */
+static void deliver_to_local(ProxyClient_t *client, char *data, uint len) {
+    if (client->builtin) {
+        handle_builtin_data(client, data, len);
+        tmux_stream_consumed(client->iMainSock, &client->stream, len);
         return;
     }
 
-    flags = ntohs(tmux_hdr.flags);          // Extract flags
-    stream_len = ntohl(tmux_hdr.length);    // Extract data length
-    streamId = ntohl(tmux_hdr.stream_id);   // Extract stream ID
+    // frame_room() sized the chunk to the free part of the buffer
+    if (len > PROXY_BUF_SIZE - client->to_local_len) {
+        ESP_LOGE(TAG, "stream %u: %u bytes overflow the local buffer", client->stream_id, len);
+        abort_proxy_client(client);
+        return;
+    }
+    memcpy(client->to_local + client->to_local_len, data, len);
+    client->to_local_len += len;
+    flush_to_local(client);
+}
+
+/**
+ * Pump data from the local service into the tmux stream
+ * Reads no more than the stream's send window, so nothing has to be held back.
+ * @param client Proxy client
+ */
+static void pump_from_local(ProxyClient_t *client) {
+    uint room = RX_BUFFER_SIZE < client->stream.send_window ? RX_BUFFER_SIZE : client->stream.send_window;
+
+    int n = recv(client->iLocalSock, g_RxBuffer, room, 0);
+    if (n > 0) {
+        tmux_stream_write(client->iMainSock, g_RxBuffer, n, &client->stream);
+        return;
+    }
+    if (n < 0 && (EAGAIN == errno || EWOULDBLOCK == errno)) {
+        return;
+    }
+    if (n < 0) {
+        ESP_LOGE(TAG, "stream %u: local recv failed: errno %d", client->stream_id, errno);
+        abort_proxy_client(client);
+        return;
+    }
+
+    // Local service closed: half-close the stream, release once frps closes too
+    ESP_LOGI(TAG, "stream %u: local service closed", client->stream_id);
+    client->local_eof = 1;
+    send_stream_close(client->iMainSock, &client->stream);
+    if (CLOSED == client->stream.state) {
+        free_proxy_client(client);
+    }
+}
+
+/**
+ * Handle data received on a work connection stream
+ * @param client Proxy client owning the stream
+ * @param data Received data (NUL terminated)
+ * @param len Data length
+ */
+static void handle_client_data(ProxyClient_t *client, char *data, uint len) {
+    if (!client->work_started) {
+        struct msg_hdr *mhdr = (struct msg_hdr*)data;
+        if (len < sizeof(struct msg_hdr) || TypeStartWorkConn != mhdr->type) {
+            ESP_LOGI(TAG, "stream %u: data before StartWorkConn dropped", client->stream_id);
+            tmux_stream_consumed(client->iMainSock, &client->stream, len);
+            return;
+        }
+
+        // StartWorkConn may share the frame with the first visitor bytes
+        uint msg_len = sizeof(struct msg_hdr) + (uint)ntoh64(mhdr->length);
+        if (msg_len > len) {
+            msg_len = len;
+        }
+        tmux_stream_consumed(client->iMainSock, &client->stream, msg_len);
+
+        client->work_started = 1;  // Mark connection ready
+        if (0 == boot_phase_us(BOOT_START_WORK_CONN)) {
+            boot_mark(BOOT_START_WORK_CONN);
+            boot_trace_dump();  // The boot timeline is complete
+        }
+        set_frpc_connection_connected();  // Set NET LED to constant on
+        replenish_pool();
+        start_local_service(client);
+        if (!client->in_use) {
+            return;  // Local service unreachable, stream was reset
+        }
+
+        data += msg_len;
+        len -= msg_len;
+    }
+
+    if (len > 0) {
+        deliver_to_local(client, data, len);
+    }
+}
+
+/**
+ * Retire a work connection once its stream is finished
+ * @param client Proxy client
+ */
+static void reap_proxy_client(ProxyClient_t *client) {
+    switch (client->stream.state) {
+    case REMOTE_CLOSE:
+        // frps is done sending: local_writable() closes once the local service has the rest
+        if (client->to_local_len > 0 && client->iLocalSock >= 0) {
+            return;
+        }
+        send_stream_close(client->iMainSock, &client->stream);
+        free_proxy_client(client);
+        break;
+    case CLOSED:
+    case RESET:
+        free_proxy_client(client);
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * Handle one frame (or chunk of a frame) from the receive ring
+ * @param frame Frame description, payload in g_RxBuffer
+ */
+static void handle_frame(tmux_frame_t *frame) {
+    int MainSock = g_pMainCtl->iMainSock;
+    tmux_stream_t *cur_stream;
+    ProxyClient_t *client = NULL;
 
     // Select stream context based on ID
-    if (1 == streamId) {
-        cur_stream = g_pMainCtl->stream;
+    if (1 == frame->stream_id) {
+        cur_stream = &g_pMainCtl->stream;
+    } else if (0 == frame->stream_id) {
+        cur_stream = NULL;                  // Session level frame (PING / GO_AWAY)
     } else {
-        cur_stream = g_pClient->stream;
+        client = get_proxy_client(frame->stream_id);
+        if (NULL == client) {
+            if (0 == frame->offset) {
+                ESP_LOGI(TAG, "frame for unknown stream %u dropped", frame->stream_id);
+            }
+            return;
+        }
+        cur_stream = &client->stream;
     }
-    if (!process_flags(flags, &(cur_stream))) {  // Process protocol flags
+    if (cur_stream && 0 == frame->offset && !process_flags(frame->flags, cur_stream)) {  // Process protocol flags
         return;
     }
 
-    switch (tmux_hdr.type) {
+    switch (frame->type) {
         case DATA: {
-            memset(&g_RxBuffer, 0, sizeof(g_RxBuffer));
-            rx_len = read(MainSock, g_RxBuffer, stream_len);  // Read payload
-
-            if (0 == rx_len) {  // Connection closed
-	            close(MainSock);
-            	RESET_DEVICE;  // 异常断开直接重启，不需要LED闪烁
-		        return;
+            if (0 == frame->len) {
+                break;
             }
+            g_RxBuffer[frame->len] = '\0';
 
-            // Handle encrypted data for main stream
-            if (decoder && (1 == streamId)) {
-                decrypted = calloc(1, stream_len);
-                my_aes_decrypt((uchar*)g_RxBuffer, stream_len, decrypted, &pt_len);
-                mhdr = (struct msg_hdr*)decrypted;
-                ESP_LOGI(TAG, "type: %c", mhdr->type);
-                ESP_LOGI(TAG, "data: %s", mhdr->data);
-            } else {  // Plaintext handling
-                mhdr = (struct msg_hdr*)g_RxBuffer;
-                ESP_LOGI(TAG, "type: %c", mhdr->type);
-                ESP_LOGI(TAG, "data: %s", mhdr->data);
+            if (client) {
+                handle_client_data(client, g_RxBuffer, frame->len);  // Credits the window as data is delivered
+                break;
             }
-            
-            if (0 == g_ProxyWork) { 
-                if (TypeLoginResp == mhdr->type) {  // Login response
-                    ESP_LOGI(TAG, "type: TypeLoginResp");
-                    handle_login_response(g_RxBuffer, rx_len);
-                    g_IsLogged = 1;
-                } else if (g_IsLogged && (NULL == decoder)) {  // Init crypto
-                    if (rx_len != 16) {  // Check IV length
-                        ESP_LOGI(TAG, "info: iv length != 16");
-                        break;
-                    }
-                    init_decoder((uint8_t*)g_RxBuffer);  // Initialize decoder
-                    init_encoder((uint8_t*)g_RxBuffer);  // Initialize encoder
-                } else if(TypeReqWorkConn == mhdr->type) {  // Work conn request
-                    ESP_LOGI(TAG, "mhdr->type == TypeReqWorkConn");
-                    if (!client_connected) {
-                        tmux_stream_write(MainSock, (char*)encoder->iv, 16, &g_pMainCtl->stream);
-                        start_proxy_services();  // Activate proxy
-                        client_connected = 1;
-                    }
-                    new_client_connect();  // Create client connection
-                    g_ProxyWork = 1;       // Enable proxy operation
-                } else if(TypeNewProxyResp == mhdr->type) {  // Proxy response
-                    ESP_LOGI(TAG, "mhdr->type == TypeNewProxyResp");
-                }
-            } else {
-                if (g_session_id == streamId) {  // Client stream
-                    if(1 == linked) {  // Data transfer
-                        // Debug print received data
-                        printf("\n################DATA RECIEVE################\n");
-                        for(int i=0;i<stream_len;i++) {
-                            if(isprint(g_RxBuffer[i])) printf("%c", g_RxBuffer[i]); 
-                            else printf(".");
-                        }
-                        printf("\n\n");
-                        for(int i=0;i<stream_len;i++) {
-                            printf("%02X ", g_RxBuffer[i]);
-                        }
-                        printf("\n############################################\n\n");
-                        
-                        // Send acknowledgment
-                        char buf[32] = {0};
-                        sprintf(buf, "%d bytes recieved!\n", stream_len);
-                        tmux_stream_write(g_pMainCtl->iMainSock, buf, strlen(buf), &g_pClient->stream);
-                        
-                        // GPIO control logic (LED and Relay control)
-                        if(strstr(g_RxBuffer, "POWER_ON")) {
-                            gpio_set_level(POWER_LED, 0);   // Turn ON power LED (active-low)
-                            gpio_set_level(RELAY, 1);       // Turn ON relay
-                            ESP_LOGI(TAG, "POWER_ON command received - LED and Relay activated");
-                        }
-                        if(strstr(g_RxBuffer, "POWER_OFF")) {
-                            gpio_set_level(POWER_LED, 1);   // Turn OFF power LED (active-low)
-                            gpio_set_level(RELAY, 0);       // Turn OFF relay
-                            ESP_LOGI(TAG, "POWER_OFF command received - LED and Relay deactivated");
-                        }
-                    }
-                    if(TypeStartWorkConn == mhdr->type) {
-                        linked = 1;  // Mark connection ready
-                        set_frpc_connection_connected();  // Set NET LED to constant on
-                    }
-                } else if (1 == streamId) {  // Main control stream
-                    ESP_LOGI(TAG, "g_ControlState: StateProxyWork");
-                    if (TypePong == mhdr->type) {  // Keep-alive response
-                        g_Pongtime = obtain_time();
-                        ESP_LOGI(TAG, "msg->type: TypePong");
-                    }
-                }
-                send_window_update(g_pMainCtl->iMainSock, &g_pClient->stream, stream_len);  // Update window
-            }
-            if (1 == streamId) {
-                SAFE_FREE(decrypted);  // Cleanup decryption buffer
+
+            feed_control((uchar*)g_RxBuffer, frame->len);
+            tmux_stream_consumed(MainSock, cur_stream, frame->len);  // Credit back in batches
+            break;
+        }
+        case WINDOW_UPDATE: {  // Peer granted more send credit
+            if (cur_stream) {
+                tmux_stream_credit(cur_stream, frame->length);
             }
             break;
         }
         case PING: {  // Handle keep-alive ping
-            handle_tcp_mux_ping(&tmux_hdr);
+            handle_tcp_mux_ping(frame->flags, frame->length);
             break;
         }
     }
+
+    // Retire the work connection once frps has closed or reset its stream
+    if (client && client->in_use && frame->last) {
+        reap_proxy_client(client);
+    }
+}
+
+/**
+ * Largest payload chunk to take from the receive ring for the next frame
+ * A work connection only gets what its local buffer can hold, so a slow
+ * local service leaves the rest of its frame in the ring (and behind it
+ * in TCP) instead of stalling the reactor, and frps gets no window credit
+ * for it until the service catches up.
+ * @return Chunk size, 0 while the frame's stream has no buffer space
+ */
+static uint frame_room() {
+    const uint whole = RX_BUFFER_SIZE - 1;  // Room for a terminating NUL, payloads are treated as strings
+    const tmux_frame_t *next = tmux_reader_peek(&g_Reader);
+
+    if (NULL == next || DATA != next->type || next->stream_id <= 1) {
+        return whole;
+    }
+    ProxyClient_t *client = get_proxy_client(next->stream_id);
+    if (NULL == client || client->builtin) {
+        return whole;
+    }
+    if (!client->work_started) {
+        return PROXY_BUF_SIZE;  // StartWorkConn is consumed, the visitor bytes after it buffered
+    }
+    return PROXY_BUF_SIZE - client->to_local_len;
+}
+
+/**
+ * Reactor timer callback: a local service kept the reader waiting too long
+ * @param arg Unused
+ */
+static void on_stall_timeout(void *arg) {
+    ProxyClient_t *client = get_proxy_client(g_stalled_stream);
+
+    if (client) {
+        ESP_LOGE(TAG, "stream %u: local service stalled", client->stream_id);
+        abort_proxy_client(client);
+    }
+}
+
+/**
+ * Hand the frames in the receive ring to their streams
+ * Stops at a frame whose stream cannot take more, and stops reading the
+ * main socket until it can; timers and the other local sockets keep running.
+ */
+static void process_frames() {
+    tmux_frame_t frame;
+    uint room = 1;
+
+    while (!g_pMainCtl->iSessionErr && (room = frame_room()) > 0 &&
+           tmux_reader_next(&g_Reader, &frame, (uchar*)g_RxBuffer, room)) {
+        handle_frame(&frame);
+    }
+    if (g_pMainCtl->iSessionErr) {
+        return;
+    }
+
+    uint32_t stalled = room ? 0 : tmux_reader_peek(&g_Reader)->stream_id;
+    if (stalled != g_stalled_stream) {
+        g_stalled_stream = stalled;
+        if (stalled) {
+            reactor_timer_start(&g_stall_timer, LOCAL_SEND_TIMEOUT_MS, on_stall_timeout, NULL);
+        } else {
+            reactor_timer_stop(&g_stall_timer);
+        }
+        reactor_mod(g_pMainCtl->iMainSock, stalled ? 0 : REACTOR_READ);
+    }
+}
+
+/**
+ * Reactor callback for the main socket
+ * @param fd Main socket
+ * @param events Ready events
+ * @param arg Unused
+ */
+static void on_main_event(int fd, int events, void *arg) {
+    if (tmux_reader_fill(&g_Reader, fd) <= 0) {  // Connection closed or failed
+        ESP_LOGI(TAG, "main connection closed: errno %d", errno);
+        mark_session_broken();
+        return;
+    }
+    heartbeat_rx();
+    process_frames();
+}
+
+/**
+ * Reactor callback for a local service socket
+ * @param fd Local socket
+ * @param events Ready events
+ * @param arg Proxy client owning the socket
+ */
+static void on_local_event(int fd, int events, void *arg) {
+    ProxyClient_t *client = (ProxyClient_t *)arg;
+
+    if (g_pMainCtl->iSessionErr) {
+        return;
+    }
+    if ((events & REACTOR_WRITE) && _SUCCESS != local_writable(client)) {
+        return;
+    }
+    if ((events & REACTOR_READ) && client->in_use) {
+        pump_from_local(client);
+    }
+}
+
+/**
+ * Reactor timer callback: the local service did not accept the connection
+ * @param arg Proxy client
+ */
+static void on_connect_timeout(void *arg) {
+    ProxyClient_t *client = (ProxyClient_t *)arg;
+
+    ESP_LOGE(TAG, "stream %u: local connect timed out", client->stream_id);
+    abort_proxy_client(client);
+}
+
+/**
+ * Update which events a local socket is watched for
+ * Write interest while connecting or holding undelivered data; read interest
+ * only while frps grants credit, which is the local-side backpressure.
+ * @param client Proxy client
+ */
+static void update_local_interest(ProxyClient_t *client) {
+    int events = 0;
+
+    if (!client->connected || client->to_local_len > 0) {
+        events |= REACTOR_WRITE;
+    }
+    if (client->connected && !client->local_eof && client->stream.send_window > 0) {
+        events |= REACTOR_READ;
+    }
+    reactor_mod(client->iLocalSock, events);
+}
+
+/**
+ * Process incoming data from server and local services
+ * Runs one reactor iteration: waits up to PROCESS_POLL_MS for the main
+ * socket, any local socket or a timer, and dispatches what is ready.
+ */
+void process_data() {
+    for (int i = 0; i < MAX_PROXY_CLIENTS; i++) {
+        if (g_clients[i].in_use && g_clients[i].iLocalSock >= 0) {
+            update_local_interest(&g_clients[i]);
+        }
+    }
+
+    if (reactor_run_once(PROCESS_POLL_MS) < 0) {
+        mark_session_broken();
+    }
+    if (g_stalled_stream && !g_pMainCtl->iSessionErr) {
+        process_frames();   // Local buffers drained, or the stalled stream is gone
+    }
 }
 
+#ifdef ESP_PLATFORM
 /**
  * 初始化GPIO引脚
  */
@@ -484,3 +1324,4 @@ void init_gpio_pins()
     io_conf.pull_up_en = 1;  // 启用上拉电阻
     gpio_config(&io_conf);
 }
+#endif //ESP_PLATFORM
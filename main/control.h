@@ -25,18 +25,49 @@
 #ifndef CONTROL_H
 #define CONTROL_H
 
+#include <stdbool.h>
 #include "tcpmux.h"
-
-#define RESET_DEVICE esp_restart()
+#include "reactor.h"
 
 // 全局变量声明
 extern bool config_mode;  // 配置模式标志（定义在main.c中）
 
+// Control session handshake, advanced by what frps sends on stream 1
+typedef enum session_state {
+	SESSION_IDLE,			// no connection to frps
+	SESSION_LOGIN_SENT,		// Login out, waiting for the plain LoginResp
+	SESSION_LOGGED_IN,		// LoginResp accepted, our IV and NewProxy are out
+	SESSION_READY,			// NewProxyResp accepted, the proxy is registered
+} session_state_t;
+
+// Largest control message (msg_hdr + JSON) frps may send on stream 1
+#define CTL_MSG_MAX			1024
+
+// Frame payload read from frps, or local service data read for frps, at a time
+#define RX_BUFFER_SIZE		2048
+
 typedef struct Control {
 	int                 iMainSock;  	//main socketfd
+	int                 iSessionErr;	//socket error seen, session must be torn down
+	session_state_t		state;
+	uint32_t			start_ms;		//connect() started, for time to ready
 	tmux_stream_t    	stream;
 } Control_t;
 
+// Reconnect backoff bounds, the delay doubles per failed attempt
+#define RECONNECT_BACKOFF_MIN_MS	1000
+#define RECONNECT_BACKOFF_MAX_MS	60000
+#define RECONNECT_SAMPLES			32	// reconnect latencies kept for percentiles
+#define READY_SAMPLES				32	// connect to proxy registered latencies kept
+
+typedef struct latency_stats {
+	uint32_t	count;		// samples since boot
+	uint32_t	p50_ms;
+	uint32_t	p90_ms;
+	uint32_t	p99_ms;
+	uint32_t	max_ms;
+} latency_stats_t;
+
 typedef enum msg_type {
 	TypeLogin                 = 'o',
 	TypeLoginResp             = '1',
@@ -73,16 +104,42 @@ typedef struct proxy_service {
 	int 	local_port;
 }ProxyService_t;
 
+// Capacity of the work connection table, must be a power of two
+#define MAX_PROXY_CLIENTS	8
+
+// Client stream ids are odd and grow by 2, so id >> 1 walks the slots in order
+#define PROXY_CLIENT_SLOT(id)	(((id) >> 1) & (MAX_PROXY_CLIENTS - 1))
+
+// Work connections kept registered with frps ahead of visitors (login pool_count)
+#ifndef CONFIG_FRPC_POOL_COUNT
+#define CONFIG_FRPC_POOL_COUNT	2
+#endif
+#define WORK_CONN_POOL_COUNT	CONFIG_FRPC_POOL_COUNT
+
+_Static_assert(WORK_CONN_POOL_COUNT >= 1 && WORK_CONN_POOL_COUNT < MAX_PROXY_CLIENTS,
+               "the work connection pool must leave table slots for active visitors");
+
+// Stream data buffered per work connection while the local socket is busy
+#define PROXY_BUF_SIZE			512
+
+#define LOCAL_CONNECT_TIMEOUT_MS	3000	// give up on an unreachable local service
+#define LOCAL_SEND_TIMEOUT_MS		5000	// give up on a local service that stops reading
+#define PROCESS_POLL_MS				100		// longest reactor wait per process_data()
+
 typedef struct proxy_client {
 	int iMainSock;          // xfrpc proxy <---> frps
 	int iLocalSock;         // xfrpc proxy <---> local service
 	struct tmux_stream 	stream;
 	uint32_t				stream_id;
-	int						connected;
+	int						in_use;		// slot allocated from the client pool
+	int						connected;	// local socket connected
 	int 					work_started;
+	int						builtin;	// local_port 0: served by the on-device relay command handler
+	int						local_eof;	// local service closed its side
+	reactor_timer_t			connect_timer;	// aborts a local connect that hangs
 	struct 	proxy_service 	*ps;
-	unsigned char			*data_tail; // storage untreated data
-	size_t					data_tail_size;
+	uint					to_local_len;
+	uchar					to_local[PROXY_BUF_SIZE];	// stream data not yet accepted by the local socket
 
 }ProxyClient_t;
 
@@ -99,7 +156,9 @@ int send_msg_frp_server(int Sockfd,  //req_msg : type = TypeLogin'o' lenth data
                     			const uint msg_len, 
                     			tmux_stream_t *stream);
 
-uint tmux_stream_write(int Sockfd, char *data, uint length, tmux_stream_t *pstream);  //req_msg : type lenth data
+int tmux_stream_write(int Sockfd, char *data, uint length, tmux_stream_t *pstream);  //req_msg : type lenth data
+
+int tmux_stream_writev(int Sockfd, struct iovec *iov, int iovcnt, tmux_stream_t *pstream);
 
 void process_data();
 
@@ -107,10 +166,22 @@ void new_work_connection(int iSock, struct tmux_stream *stream);
 
 void new_client_connect();
 
+ProxyClient_t *get_proxy_client(uint32_t stream_id);
+
+void free_proxy_client(ProxyClient_t *client);
+
 void start_proxy_services();
 
 void connect_to_server();
 
+void mark_session_broken();
+
+void get_reconnect_stats(latency_stats_t *stats);
+
+void get_ready_stats(latency_stats_t *stats);
+
+uint32_t get_boot_to_login_ms();
+
 void init_gpio_pins();
 
 #endif
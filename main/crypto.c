@@ -25,13 +25,9 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include "FreeRTOS.h"
-#include "esp_system.h"
-#include "esp_spi_flash.h"
-#include "driver/uart.h"
-#include <esp_aes.h>
+#include "platform.h"
 #include <mbedtls/platform.h>
-#include <mbedtls/cipher.h>
+#include <mbedtls/aes.h>
 #include <mbedtls/md.h>
 #include <mbedtls/pkcs5.h>
 #include <assert.h>
@@ -39,13 +35,115 @@
 #include "crypto.h"
 
 /* Global variables */
-struct frp_coder *encoder = NULL;  // Encoder structure pointer
-struct frp_coder *decoder = NULL;  // Decoder structure pointer
+struct frp_coder *encoder = NULL;  // Encoder structure pointer, NULL until the IV is set
+struct frp_coder *decoder = NULL;  // Decoder structure pointer, NULL until the IV is set
 
-const char *token = "52010";       // Secret token for key derivation
-const char *salt = "frp";          // Salt value for PBKDF2
+static struct frp_coder enc_coder, dec_coder;
+static int g_enc_iv_pending = 0;   // Encoder IV not yet sent to frps
 
-mbedtls_cipher_context_t enc_ctx, dec_ctx; // Encryption/Decryption contexts
+static const char *salt = "frp";   // Salt value for PBKDF2
+static const char *TAG = "crypto";
+
+static uint8_t g_key[AES_128_KEY_SIZE];       // PBKDF2 output, shared by encoder and decoder
+static uint8_t g_key_token_md5[16];           // Fingerprint of the token g_key was derived from
+static int g_key_ready = 0;
+
+// Running AES-128-CFB state of one direction. mbedtls_aes_crypt_cfb128()
+// works in place and on any chunk length, unlike mbedtls_cipher_update(),
+// which refuses input == output unless whole blocks are fed.
+typedef struct cfb_state {
+    uint8_t     iv[AES_128_IV_SIZE];    // Feedback register, advances with the stream
+    size_t      iv_off;                 // Bytes of the current block already used
+} cfb_state_t;
+
+static mbedtls_aes_context g_aes;           // Key schedule, CFB uses the forward cipher both ways
+static cfb_state_t g_enc_cfb, g_dec_cfb;
+
+/**
+ * Derive the AES key from the frp token and load its key schedule
+ * PBKDF2 only runs when the token differs from the one the cached key was
+ * derived from, so reconnects and repeated IV exchanges reuse the key.
+ * @param token Secret token (g_device_config.frp_token)
+ * @return 0 on success, error code otherwise
+ */
+int crypto_init_key(const char *token) {
+    uint8_t fingerprint[16];
+    int ret;
+
+    if (NULL == token) {
+        token = "";
+    }
+
+    plat_md5((const uint8_t *)token, strlen(token), fingerprint);
+
+    if (g_key_ready && 0 == memcmp(fingerprint, g_key_token_md5, sizeof(fingerprint))) {
+        return 0;  // Cached key still matches the token
+    }
+
+    // Initialize HMAC SHA-1 context for PBKDF2
+    mbedtls_md_context_t sha1_ctx;
+    mbedtls_md_init(&sha1_ctx);
+    ret = mbedtls_md_setup(&sha1_ctx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA1), 1);  // 1 = HMAC mode
+    if (0 == ret) {
+        // Derive encryption key using PBKDF2
+        ret = mbedtls_pkcs5_pbkdf2_hmac(
+            &sha1_ctx,                              // HMAC context
+            (const unsigned char *)token,           // Secret token
+            strlen(token),                          // Token length
+            (const unsigned char *)salt,            // Salt value
+            strlen(salt),                           // Salt length
+            64,                                     // Iteration count
+            AES_128_KEY_SIZE,                       // Output key length (16 bytes = 128 bits)
+            g_key                                   // Output key buffer
+        );
+    }
+    mbedtls_md_free(&sha1_ctx);
+    if (ret != 0) {
+        ESP_LOGE(TAG, "error: key derivation failed: -0x%x", -ret);
+        g_key_ready = 0;
+        return ret;
+    }
+
+    // Load the key schedule once, init_encoder/init_decoder only load the IV
+    if (g_key_ready) {
+        mbedtls_aes_free(&g_aes);
+    }
+    mbedtls_aes_init(&g_aes);
+    ret = mbedtls_aes_setkey_enc(&g_aes, g_key, 128);
+    if (ret != 0) {
+        ESP_LOGE(TAG, "error: AES key setup failed: -0x%x", -ret);
+        g_key_ready = 0;
+        return ret;
+    }
+
+    memcpy(g_key_token_md5, fingerprint, sizeof(fingerprint));
+    g_key_ready = 1;
+    ESP_LOGI(TAG, "key derived");
+
+    return 0;
+}
+
+/**
+ * Load an IV into a CFB state and restart its keystream
+ * @param cfb CFB state of the direction
+ * @param coder Coder structure to record the key and IV in
+ * @param iv Initialization vector
+ * @return Pointer to the coder, NULL if no key has been derived
+ */
+static struct frp_coder* init_coder(cfb_state_t *cfb, struct frp_coder *coder, const uint8_t *iv) {
+    if (!g_key_ready) {
+        ESP_LOGE(TAG, "error: crypto_init_key() has not run");
+        return NULL;
+    }
+
+    memcpy(coder->key, g_key, AES_128_KEY_SIZE);
+    memcpy(coder->iv, iv, AES_128_IV_SIZE);
+
+    memcpy(cfb->iv, iv, AES_128_IV_SIZE);
+    cfb->iv_off = 0;
+
+    return coder;
+}
 
 /**
  * Initialize decoder structure with given IV 
@@ -53,47 +151,7 @@ mbedtls_cipher_context_t enc_ctx, dec_ctx; // Encryption/Decryption contexts
  * @return Pointer to initialized decoder structure
  */
 struct frp_coder* init_decoder(const uint8_t *iv) {
-    const mbedtls_cipher_info_t *cipher_info;
-    
-    // Allocate and zero-initialize decoder structure
-    decoder = calloc(sizeof(struct frp_coder), 1);
-
-    // Copy token and salt into decoder
-    decoder->token = strdup(token);
-    decoder->salt = strdup(salt);
-    
-    // Initialize SHA-1 context for PBKDF2
-    mbedtls_md_context_t sha1_ctx;
-    mbedtls_md_init(&sha1_ctx);
-
-    // Get SHA-1 algorithm information
-    const mbedtls_md_info_t *sha1_info = mbedtls_md_info_from_type(MBEDTLS_MD_SHA1);
-
-    // Setup HMAC-based SHA-1 context
-    mbedtls_md_setup(&sha1_ctx, sha1_info, 1); // 1 = HMAC mode
-
-    // Derive encryption key using PBKDF2
-    mbedtls_pkcs5_pbkdf2_hmac(
-        &sha1_ctx,                             // HMAC context
-        (const unsigned char *)decoder->token,  // Secret token
-        strlen((const char *)decoder->token),   // Token length
-        (const unsigned char *)decoder->salt,   // Salt value
-        strlen((const char *)decoder->salt),    // Salt length
-        64,                                     // Iteration count
-        16,                                     // Output key length (16 bytes = 128 bits)
-        decoder->key                            // Output key buffer
-    );
-
-    // Copy initialization vector
-    memcpy(decoder->iv, iv, AES_128_IV_SIZE);
-    
-    // Initialize AES-128-CFB cipher context
-    cipher_info = mbedtls_cipher_info_from_type(MBEDTLS_CIPHER_AES_128_CFB128);
-    mbedtls_cipher_init(&dec_ctx);  
-    mbedtls_cipher_setup(&dec_ctx, cipher_info);
-    mbedtls_cipher_setkey(&dec_ctx, decoder->key, 128, MBEDTLS_DECRYPT);
-    mbedtls_cipher_set_iv(&dec_ctx, decoder->iv, 16);
-    
+    decoder = init_coder(&g_dec_cfb, &dec_coder, iv);
     return decoder;
 }
 
@@ -103,108 +161,61 @@ struct frp_coder* init_decoder(const uint8_t *iv) {
  * @return Pointer to initialized encoder structure
  */
 struct frp_coder* init_encoder(const uint8_t *iv) {
-    const mbedtls_cipher_info_t *cipher_info;
-    
-    // Allocate and zero-initialize encoder structure
-    encoder = calloc(sizeof(struct frp_coder), 1);
-    
-    // Copy token and salt into encoder
-    encoder->token = strdup(token);
-    encoder->salt = strdup(salt);
-    
-    // Initialize SHA-1 context for PBKDF2
-    mbedtls_md_context_t sha1_ctx;
-    mbedtls_md_init(&sha1_ctx);
-    
-    // Select the SHA-1 algorithm and initialize
-    const mbedtls_md_info_t *sha1_info = mbedtls_md_info_from_type(MBEDTLS_MD_SHA1);
-    
-    // Setup HMAC-based SHA-1 context
-    mbedtls_md_setup(&sha1_ctx, sha1_info, 1);  // 1 = HMAC mode
-
-    // Derive encryption key using PBKDF2
-    mbedtls_pkcs5_pbkdf2_hmac(
-        &sha1_ctx,	// HMAC context
-        (const unsigned char *)encoder->token,  // Secret token
-        strlen((const char *)encoder->token),   // Token length
-        (const unsigned char *)encoder->salt,   // Salt value
-        strlen((const char *)encoder->salt),    // Salt length
-        64,	// Iteration count
-        16,	//Output key length (16 bytes = 128 bits)
-        encoder->key	// Output key buffer
-    );
-
-    // Copy initialization vector
-    memcpy(encoder->iv, iv, AES_128_IV_SIZE);
-    
-    // Initialize AES-128-CFB cipher context
-    cipher_info = mbedtls_cipher_info_from_type(MBEDTLS_CIPHER_AES_128_CFB128);
-    mbedtls_cipher_init(&enc_ctx);  
-    mbedtls_cipher_setup(&enc_ctx, cipher_info);
-    mbedtls_cipher_setkey(&enc_ctx, encoder->key, 128, MBEDTLS_ENCRYPT);
-    mbedtls_cipher_set_iv(&enc_ctx, encoder->iv, 16);
-    
+    encoder = init_coder(&g_enc_cfb, &enc_coder, iv);
+    g_enc_iv_pending = (NULL != encoder);
     return encoder;
 }
 
 /**
- * Decrypt data using AES-128-CFB
- * @param ciphertext Pointer to ciphertext buffer
- * @param ct_len Length of ciphertext
- * @param plaintext Pointer to plaintext buffer
- * @param pt_len Pointer to plaintext length (updated by function)
- * @return 0 on success, error code otherwise
+ * Whether the encoder IV still has to go out with the next encrypted bytes
  */
-int my_aes_decrypt(unsigned char *ciphertext, size_t ct_len, 
-                  unsigned char *plaintext, size_t *pt_len) {
-    int ret;
-    size_t finish_olen;
-
-    // Process ciphertext in multiple steps
-    if ((ret = mbedtls_cipher_update(&dec_ctx, ciphertext, ct_len, 
-                                    plaintext, pt_len)) != 0) {
-        goto exit;
-    }
+int crypto_encoder_iv_pending(void) {
+    return g_enc_iv_pending;
+}
 
-    // Finalize decryption process
-    if ((ret = mbedtls_cipher_finish(&dec_ctx, plaintext + *pt_len, 
-                                    &finish_olen)) != 0) {
-        goto exit;
+/**
+ * Take the encoder IV if frps has not been sent it yet
+ * Like frp's crypto writer, the IV goes out in front of the first
+ * encrypted bytes.
+ * @return IV to send now, NULL once it has been taken
+ */
+const uint8_t *crypto_take_encoder_iv(void) {
+    if (!g_enc_iv_pending) {
+        return NULL;
     }
- 
-    *pt_len += finish_olen;
+    g_enc_iv_pending = 0;
+    return enc_coder.iv;
+}
 
-exit:
-    return ret;  // Return 0 on success, error code otherwise
+/**
+ * Forget the session IVs; the derived key stays cached
+ * encoder/decoder read as NULL until the next IV exchange.
+ */
+void crypto_reset_coders(void) {
+    encoder = NULL;
+    decoder = NULL;
+    g_enc_iv_pending = 0;
 }
 
 /**
- * Encrypt data using AES-128-CFB
- * @param plaintext Pointer to plaintext buffer
- * @param pt_len Length of plaintext
- * @param ciphertext Pointer to ciphertext buffer
- * @param ct_len Pointer to ciphertext length (updated by function)
+ * Decrypt a chunk of the inbound stream in place using AES-128-CFB
+ * CFB is a stream mode: the CFB state carries the keystream position
+ * across calls, so chunks may split anywhere, including mid-frame, as long
+ * as they are fed in order. No finish step is needed.
+ * @param buf Ciphertext in, plaintext out
+ * @param len Length of the chunk
  * @return 0 on success, error code otherwise
  */
-int my_aes_encrypt(const unsigned char *plaintext, size_t pt_len,
-                  unsigned char *ciphertext, size_t *ct_len) {
-    int ret;
-    size_t finish_olen;
-
-    // Process plaintext in multiple steps
-    if ((ret = mbedtls_cipher_update(&enc_ctx, plaintext, pt_len,
-                                    ciphertext, ct_len)) != 0) {
-        goto exit;
-    }
-
-    // Finalize encryption process
-    if ((ret = mbedtls_cipher_finish(&enc_ctx, ciphertext + *ct_len,
-                                    &finish_olen)) != 0) {
-        goto exit;
-    }
-    
-    *ct_len += finish_olen;
+int my_aes_decrypt_stream(unsigned char *buf, size_t len) {
+    return mbedtls_aes_crypt_cfb128(&g_aes, MBEDTLS_AES_DECRYPT, len, &g_dec_cfb.iv_off, g_dec_cfb.iv, buf, buf);
+}
 
-exit:
-    return ret;  // Return 0 on success, error code otherwise
+/**
+ * Encrypt a chunk of the outbound stream in place using AES-128-CFB
+ * @param buf Plaintext in, ciphertext out
+ * @param len Length of the chunk
+ * @return 0 on success, error code otherwise
+ */
+int my_aes_encrypt_stream(unsigned char *buf, size_t len) {
+    return mbedtls_aes_crypt_cfb128(&g_aes, MBEDTLS_AES_ENCRYPT, len, &g_enc_cfb.iv_off, g_enc_cfb.iv, buf, buf);
 }
@@ -34,15 +34,18 @@
 
 struct frp_coder {
 	uint8_t 	key[16];
-	char 		*salt;
 	uint8_t 	iv[16];
-	char 		*token;
 }; 
 
+int crypto_init_key(const char *token);
+
 struct frp_coder* init_decoder(const uint8_t *iv);
 struct frp_coder* init_encoder(const uint8_t *iv);
+void crypto_reset_coders(void);
+int crypto_encoder_iv_pending(void);
+const uint8_t *crypto_take_encoder_iv(void);
 
-int my_aes_encrypt(const unsigned char *plaintext, size_t pt_len, unsigned char *ciphertext, size_t *ct_len);
-int my_aes_decrypt(unsigned char *ciphertext, size_t ct_len, unsigned char *plaintext, size_t *pt_len); 
+int my_aes_encrypt_stream(unsigned char *buf, size_t len);
+int my_aes_decrypt_stream(unsigned char *buf, size_t len);
 
 #endif // _CRYPTO_H_
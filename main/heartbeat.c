@@ -0,0 +1,197 @@
+/********************************************************************\
+ * This program is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as   *
+ * published by the Free Software Foundation; either version 2 of   *
+ * the License, or (at your option) any later version.              *
+ *                                                                  *
+ * This program is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of   *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the    *
+ * GNU General Public License for more details.                     *
+ *                                                                  *
+ * You should have received a copy of the GNU General Public License*
+ * along with this program; if not, contact:                        *
+ *                                                                  *
+ * Free Software Foundation           Voice:  +1-617-542-5942       *
+ * 59 Temple Place - Suite 330        Fax:    +1-617-542-2652       *
+ * Boston, MA  02111-1307,  USA       gnu@gnu.org                   *
+ *                                                                  *
+\********************************************************************/
+
+/** @file heartbeat.c
+    @author Copyright (C) 2025 LYC <365256281@qq.com>
+*/
+
+#include <string.h>
+#include "platform.h"
+#include "control.h"
+#include "reactor.h"
+#include "tcpmux.h"
+#include "msg.h"
+#include "heartbeat.h"
+
+static const char *TAG = "heartbeat";
+
+extern Control_t *g_pMainCtl;
+
+static reactor_timer_t g_hb_timer;
+static int      g_hb_sock = -1;
+static uint32_t g_interval_ms;
+static uint32_t g_timeout_ms;
+static uint32_t g_keepalive_ms;     // longest gap between Pings frps tolerates
+static uint32_t g_last_rx_ms;       // anything received from frps
+static uint32_t g_last_ping_ms;     // app Ping sent
+static uint32_t g_skip_ms;          // last Ping sent or skipped, paces the suppressed count
+static uint32_t g_last_probe_ms;    // yamux PING sent
+static uint32_t g_ping_out_ms;      // Ping awaiting its Pong, 0 if none
+static uint32_t g_probe_id = 0;
+static heartbeat_stats_t g_stats;
+
+/**
+ * Enable TCP keepalive on the main socket
+ * Catches a peer that disappears while nothing is being written, which no
+ * amount of waiting on read would notice.
+ * @param Sockfd Main socket
+ */
+static void set_keepalive(int Sockfd) {
+    int on = 1;
+    int idle = g_interval_ms / 1000;
+    int intvl = HEARTBEAT_PROBE_MS / 1000;
+    int cnt = (g_timeout_ms - g_interval_ms) / HEARTBEAT_PROBE_MS + 1;
+
+    if (setsockopt(Sockfd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on)) < 0 ||
+        setsockopt(Sockfd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle)) < 0 ||
+        setsockopt(Sockfd, IPPROTO_TCP, TCP_KEEPINTVL, &intvl, sizeof(intvl)) < 0 ||
+        setsockopt(Sockfd, IPPROTO_TCP, TCP_KEEPCNT, &cnt, sizeof(cnt)) < 0) {
+        ESP_LOGW(TAG, "TCP keepalive unavailable: errno %d", errno);
+    }
+}
+
+/**
+ * Detector tick
+ * @param arg Unused
+ */
+static void on_heartbeat_tick(void *arg) {
+    uint32_t now = plat_now_ms();
+    uint32_t idle = now - g_last_rx_ms;
+
+    if (idle >= g_timeout_ms) {
+        ESP_LOGE(TAG, "frps silent for %u ms, session dead", idle);
+        g_stats.dead++;
+        mark_session_broken();
+        return;
+    }
+
+    // Pings need our encoder; until then only the timeout applies
+    if (g_pMainCtl->state >= SESSION_LOGGED_IN && !g_pMainCtl->iSessionErr) {
+        uint32_t since_ping = now - g_last_ping_ms;
+
+        // Quiet link, or frps's own Ping deadline even while traffic flows
+        if ((idle >= g_interval_ms && since_ping >= g_interval_ms) || since_ping >= g_keepalive_ms) {
+            if (_SUCCESS == send_enc_msg_frp_server(g_hb_sock, TypePing, "{}", 2, &g_pMainCtl->stream)) {
+                g_last_ping_ms = now;
+                g_skip_ms = now;
+                if (0 == g_ping_out_ms) {
+                    g_ping_out_ms = now | 1;  // Never 0, that means none outstanding
+                }
+                g_stats.pings++;
+            }
+        } else if (now - g_skip_ms >= g_interval_ms) {
+            g_skip_ms = now;  // Traffic stood in for this Ping
+            g_stats.suppressed++;
+        }
+    }
+
+    // Quiet past a Ping's answer time: probe below the encryption layer as well
+    if (idle >= g_interval_ms + HEARTBEAT_PROBE_MS && now - g_last_probe_ms >= HEARTBEAT_PROBE_MS) {
+        if (_SUCCESS == send_ping(g_hb_sock, ++g_probe_id)) {
+            g_last_probe_ms = now;
+            g_stats.probes++;
+        }
+    }
+
+    reactor_timer_start(&g_hb_timer, HEARTBEAT_TICK_MS, on_heartbeat_tick, NULL);
+}
+
+/**
+ * Start watching a new control session
+ * Called once connected, so a login frps never answers times out too.
+ * @param Sockfd Main socket
+ * @param interval_s Configured heartbeat interval (hb_itvl)
+ * @param timeout_s Configured heartbeat timeout (hb_to)
+ */
+void heartbeat_start(int Sockfd, uint32_t interval_s, uint32_t timeout_s) {
+    uint32_t now = plat_now_ms();
+
+    if (0 == interval_s) {
+        interval_s = 1;
+    }
+    if (timeout_s <= interval_s) {
+        ESP_LOGW(TAG, "heartbeat timeout %u s not above interval %u s, using %u s",
+                 timeout_s, interval_s, interval_s * 3);
+        timeout_s = interval_s * 3;
+    }
+    g_interval_ms = interval_s * 1000;
+    g_timeout_ms = timeout_s * 1000;
+    // frps drops a control that has not pinged within its heartbeat_timeout,
+    // whose default (90 s) is hb_to's; stay well inside it
+    g_keepalive_ms = g_timeout_ms / 2 > g_interval_ms ? g_timeout_ms / 2 : g_interval_ms;
+
+    g_hb_sock = Sockfd;
+    g_last_rx_ms = now;
+    g_last_ping_ms = now;
+    g_skip_ms = now;
+    g_last_probe_ms = now;
+    g_ping_out_ms = 0;
+    set_keepalive(Sockfd);
+    reactor_timer_start(&g_hb_timer, HEARTBEAT_TICK_MS, on_heartbeat_tick, NULL);
+}
+
+/**
+ * Stop watching, the session is being torn down
+ */
+void heartbeat_stop(void) {
+    reactor_timer_stop(&g_hb_timer);
+    g_hb_sock = -1;
+}
+
+/**
+ * Note that frps sent something, proof of liveness
+ */
+void heartbeat_rx(void) {
+    g_last_rx_ms = plat_now_ms();
+}
+
+/**
+ * Note a Pong from frps
+ */
+void heartbeat_pong(void) {
+    uint32_t now = plat_now_ms();
+
+    g_stats.pongs++;
+    g_last_rx_ms = now;
+    if (g_ping_out_ms) {
+        g_stats.last_rtt_ms = now - g_ping_out_ms;
+        if (g_stats.last_rtt_ms > g_stats.max_rtt_ms) {
+            g_stats.max_rtt_ms = g_stats.last_rtt_ms;
+        }
+        g_ping_out_ms = 0;
+    }
+}
+
+/**
+ * Get heartbeat statistics since boot
+ * @param stats Output statistics
+ */
+void heartbeat_get_stats(heartbeat_stats_t *stats) {
+    memcpy(stats, &g_stats, sizeof(heartbeat_stats_t));
+}
+
+/**
+ * Log heartbeat statistics
+ */
+void heartbeat_dump_stats(void) {
+    ESP_LOGI(TAG, "pings %u (suppressed %u), pongs %u, probes %u, dead %u, rtt %u ms (max %u)",
+             g_stats.pings, g_stats.suppressed, g_stats.pongs, g_stats.probes, g_stats.dead,
+             g_stats.last_rtt_ms, g_stats.max_rtt_ms);
+}
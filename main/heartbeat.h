@@ -0,0 +1,61 @@
+/********************************************************************\
+ * This program is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as   *
+ * published by the Free Software Foundation; either version 2 of   *
+ * the License, or (at your option) any later version.              *
+ *                                                                  *
+ * This program is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of   *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the    *
+ * GNU General Public License for more details.                     *
+ *                                                                  *
+ * You should have received a copy of the GNU General Public License*
+ * along with this program; if not, contact:                        *
+ *                                                                  *
+ * Free Software Foundation           Voice:  +1-617-542-5942       *
+ * 59 Temple Place - Suite 330        Fax:    +1-617-542-2652       *
+ * Boston, MA  02111-1307,  USA       gnu@gnu.org                   *
+ *                                                                  *
+\********************************************************************/
+
+/** @file heartbeat.h
+    @author Copyright (C) 2025 LYC <365256281@qq.com>
+*/
+
+#ifndef HEARTBEAT_H
+#define HEARTBEAT_H
+
+#include <stdint.h>
+
+// Dead peer detection for the control session, run on the reactor task.
+// Every byte from frps (stream data, Pong, yamux PING/ACK, window updates)
+// proves the peer alive; app Pings are only sent when the link has been
+// quiet, a yamux PING probes a Ping that went unanswered, and TCP
+// keepalive covers a peer that vanishes while we are not writing.
+
+#define HEARTBEAT_TICK_MS		1000	// detector resolution
+#define HEARTBEAT_PROBE_MS		5000	// yamux PING spacing once a Ping is unanswered
+
+typedef struct heartbeat_stats {
+	uint32_t	pings;			// app Pings sent
+	uint32_t	pongs;
+	uint32_t	suppressed;		// Pings skipped because traffic proved liveness
+	uint32_t	probes;			// yamux PINGs sent
+	uint32_t	dead;			// sessions torn down by the detector
+	uint32_t	last_rtt_ms;	// Ping to Pong
+	uint32_t	max_rtt_ms;
+} heartbeat_stats_t;
+
+void heartbeat_start(int Sockfd, uint32_t interval_s, uint32_t timeout_s);
+
+void heartbeat_stop(void);
+
+void heartbeat_rx(void);
+
+void heartbeat_pong(void);
+
+void heartbeat_get_stats(heartbeat_stats_t *stats);
+
+void heartbeat_dump_stats(void);
+
+#endif
@@ -25,15 +25,10 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include "esp_system.h"
-#include "esp_log.h"
+#include "platform.h"
 #include "login.h"
 #include "msg.h"
 #include "config.h"
-#include "lwip/err.h"
-#include "lwip/sockets.h"
-#include "lwip/sys.h"
-#include <lwip/netdb.h>
 
 login_t *g_pLogin;         // Global login information structure
 MainConfig_t *g_pMainConf; // Global main configuration structure
@@ -70,16 +65,13 @@ int init_login()
     g_pLogin->timestamp      = 0;                         // Initialize timestamp
     g_pLogin->run_id         = NULL;
     g_pLogin->metas          = NULL;
-    g_pLogin->pool_count     = 1;
-    g_pLogin->privilege_key  = NULL;
+    g_pLogin->pool_count     = WORK_CONN_POOL_COUNT;    // Work connections frps keeps ready
     g_pLogin->logged         = 0;
 
     uint8_t mac[6]; // Buffer for MAC address
     
     // Read WiFi station MAC address
-    esp_err_t ret = esp_read_mac(mac, ESP_MAC_WIFI_STA);
-    
-    if (ESP_OK == ret) 
+    if (_SUCCESS == plat_read_mac(mac)) 
     {
         ESP_LOGI(TAG, "MAC: %02X:%02X:%02X:%02X:%02X:%02X",
                 mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
@@ -164,24 +156,26 @@ void dump_common_conf()
 int handle_login_response(const char* buf, int len) 
 {
     msg_hdr_t* mhdr = (struct msg_hdr*)buf; // Parse message header
+    struct login_resp lres;
     ESP_LOGI(TAG, "handle_login_response");
 
+    if (len < (int)sizeof(struct msg_hdr)) {
+        return _FAIL;
+    }
+
     // Unmarshal login response data
-    struct login_resp* lres = login_resp_unmarshal((const char*)mhdr->data);
-    if (!lres) {
+    if (_SUCCESS != login_resp_unmarshal(mhdr->data, len - sizeof(struct msg_hdr), &lres)) {
         return _FAIL;
     }
 
     // Validate login response
-    if (!login_resp_check(lres)) {
+    if (!login_resp_check(&lres)) {
         ESP_LOGI(TAG, "login failed");
-        free(lres);
         return _FAIL;
     }
-    free(lres);
 
     // Calculate remaining data length
-    int login_len = ntohs(mhdr->length); // Convert network byte order to host
+    int login_len = (int)ntoh64(mhdr->length); // Convert network byte order to host
     int lien = len - login_len - sizeof(struct msg_hdr);
 
     ESP_LOGI(TAG, "login success! login_len %d len %d lien %d", login_len, len, lien);
@@ -206,8 +200,8 @@ int handle_login_response(const char* buf, int len)
 int login_resp_check(struct login_resp* lr) 
 {
     // Check if run_id is valid
-    if ((NULL == lr->run_id) || strlen(lr->run_id) <= 1) {
-        if (lr->error && strlen(lr->error) > 0) {
+    if (strlen(lr->run_id) <= 1 || strlen(lr->error) > 0) {
+        if (strlen(lr->error) > 0) {
             ESP_LOGI(TAG, "login response error: %s", lr->error);
         }
         ESP_LOGI(TAG, "login failed!");
@@ -35,7 +35,7 @@ typedef struct login {
 	char 		*os;
 	char		*arch;
 	char 		*user;
-	char 		*privilege_key;
+	char 		privilege_key[33];	// MD5 hex of token + timestamp
     int 	timestamp;
 	char 		*run_id;
 	char		*metas;
@@ -46,9 +46,9 @@ typedef struct login {
 } login_t;
 
 struct login_resp {
-	char 	*version;
-	char	*run_id;
-	char 	*error;
+	char 	version[16];
+	char	run_id[64];
+	char 	error[128];
 };
 
 typedef struct Main_Conf {
@@ -40,6 +40,8 @@
 #include "control.h"
 #include "driver/gpio.h"
 #include "timer.h"  // 添加timer.h以使用get_tick_count函数
+#include "boottrace.h"
+#include "memplan.h"
 // #include "esp_spiffs.h" // 移除SPIFFS头文件
 
 // GPIO pin definitions are now in config.h
@@ -48,9 +50,6 @@
  * Main application entry point.
  * Initializes system components, network interfaces, and establishes server connection.
  */
-// 全局html数组和长度
-uint8_t g_web_html[7200] = {0};  // 7200字节，支持6个1200字节的文件
-size_t g_web_html_size = 7200;
 
 // 配置模式标志（全局变量，供其他模块使用）
 bool config_mode = false;
@@ -75,41 +74,27 @@ void app_main()
 
     // Initialize Non-Volatile Storage (NVS)
     ESP_ERROR_CHECK(nvs_flash_init());
+    boot_mark(BOOT_NVS);
     
     // Initialize configuration system
     ESP_ERROR_CHECK(config_init());
+    boot_mark(BOOT_CONFIG);
     
     // Initialize GPIO pins
     init_gpio_pins();
+    config_key_init();  // Long press on KEY switches modes at any time
+    boot_mark(BOOT_GPIO);
     
-    // Initialize timer (needed for config mode detection)
+    // Initialize timer (LEDs and the long press check)
     CreateTimer();
+    boot_mark(BOOT_TIMER);
     
-    // Check if should enter config mode
+    // Check if should enter config mode, without waiting
     config_mode = check_config_mode();
+    mem_plan_init(config_mode ? RUN_MODE_CONFIG : RUN_MODE_TUNNEL);  // Only this mode's buffers are resident
+    boot_mark(BOOT_MODE);
 
 
-    
-    // 启动时从NVS读取webpart1-6（只读模式）
-    nvs_handle nvs_handle_web;
-    esp_err_t err_web = nvs_open("config", NVS_READONLY, &nvs_handle_web);
-    if (err_web == ESP_OK) {
-        size_t part_size = 1200;  // 修改为1200字节，匹配split -b 1200
-        size_t len = part_size;
-        for (int i = 1; i <= 6; ++i) {  // 读取6个部分
-            char key[32];
-            snprintf(key, sizeof(key), "webpart%d", i);
-            err_web = nvs_get_blob(nvs_handle_web, key, g_web_html + (i-1)*part_size, &len);
-            if (err_web != ESP_OK) {
-                ESP_LOGE("MAIN", "Failed to read %s from NVS: %s", key, esp_err_to_name(err_web));
-            }
-            len = part_size;
-        }
-        nvs_close(nvs_handle_web);
-    } else {
-        ESP_LOGE("MAIN", "Failed to open NVS for web html: %s", esp_err_to_name(err_web));
-    }
-
     if (config_mode) {
         // 配置模式：启动WiFi热点和Web服务器
         ESP_LOGI("MAIN", "=== Entering Configuration Mode ===");
@@ -176,11 +161,13 @@ void app_main()
         
         // WiFi连接成功，点亮网络LED
         gpio_set_level(LINK_LED, 0);
+        boot_mark(BOOT_WIFI);
         ESP_LOGI("MAIN", "WiFi connected successfully");
         
         // 初始化自定义硬件组件
         ESP_LOGI("MAIN", "Initializing FRP client components...");
         initialize();
+        boot_mark(BOOT_INIT);
         
         // 建立与远程服务器的连接
         ESP_LOGI("MAIN", "Connecting to FRP server...");
@@ -0,0 +1,56 @@
+/********************************************************************\
+ * This program is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as   *
+ * published by the Free Software Foundation; either version 2 of   *
+ * the License, or (at your option) any later version.              *
+ *                                                                  *
+ * This program is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of   *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the    *
+ * GNU General Public License for more details.                     *
+ *                                                                  *
+ * You should have received a copy of the GNU General Public License*
+ * along with this program; if not, contact:                        *
+ *                                                                  *
+ * Free Software Foundation           Voice:  +1-617-542-5942       *
+ * 59 Temple Place - Suite 330        Fax:    +1-617-542-2652       *
+ * Boston, MA  02111-1307,  USA       gnu@gnu.org                   *
+ *                                                                  *
+\********************************************************************/
+
+/** @file memplan.c
+    @author Copyright (C) 2025 LYC <365256281@qq.com>
+*/
+
+#include <string.h>
+#include "platform.h"
+#include "memplan.h"
+
+#define MEM_STR_(x)	#x
+#define MEM_STR(x)	MEM_STR_(x)
+#pragma message("memplan: tunnel budget " MEM_STR(MEM_TUNNEL_BUDGET) " B, config budget " MEM_STR(MEM_CONFIG_BUDGET) " B, one shared arena")
+
+static const char *TAG = "memplan";
+
+static mem_arena_t g_arena;
+static int g_mode = -1;     // run mode that owns g_arena, -1 before mem_plan_init()
+
+void mem_plan_init(run_mode_t mode) {
+    static const char *const names[RUN_MODES] = { "tunnel", "config" };
+    static const uint32_t used[RUN_MODES] = { sizeof(tunnel_mem_t), sizeof(config_mem_t) };
+    static const uint32_t budget[RUN_MODES] = { MEM_TUNNEL_BUDGET, MEM_CONFIG_BUDGET };
+
+    memset(&g_arena, 0, sizeof(g_arena));
+    g_mode = mode;
+    ESP_LOGI(TAG, "%s mode: %u of %u B budget, arena %u B (tunnel %u, config %u)",
+             names[mode], used[mode], budget[mode], (uint32_t)sizeof(g_arena),
+             used[RUN_MODE_TUNNEL], used[RUN_MODE_CONFIG]);
+}
+
+tunnel_mem_t *mem_tunnel() {
+    return g_mode == RUN_MODE_TUNNEL ? &g_arena.tunnel : NULL;
+}
+
+config_mem_t *mem_config() {
+    return g_mode == RUN_MODE_CONFIG ? &g_arena.config : NULL;
+}
@@ -0,0 +1,83 @@
+/********************************************************************\
+ * This program is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as   *
+ * published by the Free Software Foundation; either version 2 of   *
+ * the License, or (at your option) any later version.              *
+ *                                                                  *
+ * This program is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of   *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the    *
+ * GNU General Public License for more details.                     *
+ *                                                                  *
+ * You should have received a copy of the GNU General Public License*
+ * along with this program; if not, contact:                        *
+ *                                                                  *
+ * Free Software Foundation           Voice:  +1-617-542-5942       *
+ * 59 Temple Place - Suite 330        Fax:    +1-617-542-2652       *
+ * Boston, MA  02111-1307,  USA       gnu@gnu.org                   *
+ *                                                                  *
+\********************************************************************/
+
+/** @file memplan.h
+    @author Copyright (C) 2025 LYC <365256281@qq.com>
+*/
+
+#ifndef MEMPLAN_H
+#define MEMPLAN_H
+
+#include <stdint.h>
+#include "control.h"
+
+// The config portal and the frpc tunnel never run in the same boot, so
+// their large buffers share one static arena. app_main() picks the mode
+// once; only that mode's view of the arena is handed out afterwards.
+
+typedef enum run_mode {
+	RUN_MODE_TUNNEL,		// frpc client, connected to frps
+	RUN_MODE_CONFIG,		// WiFi AP and config web server
+	RUN_MODES,
+} run_mode_t;
+
+// Config portal buffers
+#define WEB_PAGE_CHUNK		512		// page bytes read from flash per chunk sent
+#define WEB_POST_MAX		1024	// largest config form accepted
+
+// Per-mode ceilings, checked at compile time and printed by the build
+#define MEM_TUNNEL_BUDGET	8192
+#define MEM_CONFIG_BUDGET	2048
+
+typedef struct tunnel_mem {
+	char			rx[RX_BUFFER_SIZE];			// frame payload from frps, local data to frps
+	uchar			ctl_msg[CTL_MSG_MAX + 1];	// control message being assembled, +1 for a NUL
+	ProxyClient_t	clients[MAX_PROXY_CLIENTS];	// work connection pool
+} tunnel_mem_t;
+
+typedef struct config_mem {
+	char			page[WEB_PAGE_CHUNK];		// config page chunk read from flash
+	char			post[WEB_POST_MAX + 1];		// config form, +1 for a NUL
+} config_mem_t;
+
+typedef union mem_arena {
+	tunnel_mem_t	tunnel;
+	config_mem_t	config;
+} mem_arena_t;
+
+_Static_assert(sizeof(tunnel_mem_t) <= MEM_TUNNEL_BUDGET, "tunnel buffers exceed MEM_TUNNEL_BUDGET");
+_Static_assert(sizeof(config_mem_t) <= MEM_CONFIG_BUDGET, "config buffers exceed MEM_CONFIG_BUDGET");
+
+/**
+ * @brief Hand the arena to one run mode, zeroed; call once at startup
+ */
+void mem_plan_init(run_mode_t mode);
+
+/**
+ * @return the tunnel buffers, NULL unless the tunnel mode was planned
+ */
+tunnel_mem_t *mem_tunnel();
+
+/**
+ * @return the config portal buffers, NULL unless the config mode was planned
+ */
+config_mem_t *mem_config();
+
+#endif
@@ -0,0 +1,361 @@
+/********************************************************************\
+ * This program is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as   *
+ * published by the Free Software Foundation; either version 2 of   *
+ * the License, or (at your option) any later version.              *
+ *                                                                  *
+ * This program is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of   *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the    *
+ * GNU General Public License for more details.                     *
+ *                                                                  *
+ * You should have received a copy of the GNU General Public License*
+ * along with this program; if not, contact:                        *
+ *                                                                  *
+ * Free Software Foundation           Voice:  +1-617-542-5942       *
+ * 59 Temple Place - Suite 330        Fax:    +1-617-542-2652       *
+ * Boston, MA  02111-1307,  USA       gnu@gnu.org                   *
+ *                                                                  *
+\********************************************************************/
+
+/** @file minijson.c
+    @author Copyright (C) 2025 LYC <365256281@qq.com>
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "minijson.h"
+
+/**
+ * Append bytes to the writer, flagging overflow instead of truncating
+ * One byte is always kept back for the terminating NUL.
+ */
+static void put(json_writer_t *w, const char *s, size_t n) {
+    if (w->overflow || w->len + n >= w->size) {
+        w->overflow = 1;
+        return;
+    }
+    memcpy(w->buf + w->len, s, n);
+    w->len += n;
+}
+
+static void put_char(json_writer_t *w, char c) {
+    put(w, &c, 1);
+}
+
+/**
+ * Append a quoted string, escaping what JSON requires
+ * Unescaped runs are copied in one go.
+ */
+static void put_string(json_writer_t *w, const char *s) {
+    static const char hex[] = "0123456789abcdef";
+    const char *run = s;
+
+    put_char(w, '"');
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        put(w, run, s - run);
+        run = s + 1;
+        switch (c) {
+        case '"':  put(w, "\\\"", 2); break;
+        case '\\': put(w, "\\\\", 2); break;
+        case '\n': put(w, "\\n", 2); break;
+        case '\r': put(w, "\\r", 2); break;
+        case '\t': put(w, "\\t", 2); break;
+        default: {
+            char u[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf] };
+            put(w, u, sizeof(u));
+            break;
+        }
+        }
+    }
+    put(w, run, s - run);
+    put_char(w, '"');
+}
+
+static void put_key(json_writer_t *w, const char *key) {
+    if (w->members++) {
+        put_char(w, ',');
+    }
+    put_string(w, key);
+    put_char(w, ':');
+}
+
+/**
+ * Start a JSON object in a caller buffer
+ * @param w Writer
+ * @param buf Output buffer, e.g. the transmit arena payload
+ * @param size Buffer size
+ */
+void json_begin(json_writer_t *w, char *buf, size_t size) {
+    w->buf = buf;
+    w->size = size;
+    w->len = 0;
+    w->members = 0;
+    w->overflow = 0;
+    put_char(w, '{');
+}
+
+/**
+ * Add a string member, NULL is written as null
+ */
+void json_add_string(json_writer_t *w, const char *key, const char *val) {
+    put_key(w, key);
+    if (NULL == val) {
+        put(w, "null", 4);
+    } else {
+        put_string(w, val);
+    }
+}
+
+void json_add_int(json_writer_t *w, const char *key, long val) {
+    char num[24];
+
+    put_key(w, key);
+    put(w, num, snprintf(num, sizeof(num), "%ld", val));
+}
+
+void json_add_bool(json_writer_t *w, const char *key, int val) {
+    put_key(w, key);
+    if (val) {
+        put(w, "true", 4);
+    } else {
+        put(w, "false", 5);
+    }
+}
+
+void json_add_null(json_writer_t *w, const char *key) {
+    put_key(w, key);
+    put(w, "null", 4);
+}
+
+/**
+ * Close the object
+ * @param w Writer
+ * @return Length of the NUL terminated JSON text, 0 if it did not fit
+ */
+size_t json_end(json_writer_t *w) {
+    put_char(w, '}');
+    if (w->overflow) {
+        return 0;
+    }
+    w->buf[w->len] = '\0';
+    return w->len;
+}
+
+/* ------------------------------------------------------------------ */
+
+typedef struct json_cursor {
+    const char  *p;
+    const char  *end;
+} json_cursor_t;
+
+static void skip_ws(json_cursor_t *c) {
+    while (c->p < c->end && (' ' == *c->p || '\t' == *c->p || '\n' == *c->p || '\r' == *c->p)) {
+        c->p++;
+    }
+}
+
+/**
+ * Append one byte to a field value, dropping what does not fit
+ */
+static void out_char(json_field_t *f, size_t *olen, char ch) {
+    if (f && *olen + 1 < f->size) {
+        f->out[(*olen)++] = ch;
+    }
+}
+
+static int hex_val(char ch) {
+    if (ch >= '0' && ch <= '9') return ch - '0';
+    if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+    return -1;
+}
+
+/**
+ * Consume a string, cursor on the opening quote
+ * @param c Cursor
+ * @param f Field to unescape into, NULL to skip
+ * @param olen Output length so far
+ * @return 0 on success, -1 if malformed
+ */
+static int scan_string(json_cursor_t *c, json_field_t *f, size_t *olen) {
+    c->p++;  // Opening quote
+    while (c->p < c->end) {
+        char ch = *c->p++;
+        if ('"' == ch) {
+            return 0;
+        }
+        if ('\\' != ch) {
+            out_char(f, olen, ch);
+            continue;
+        }
+        if (c->p >= c->end) {
+            return -1;
+        }
+        ch = *c->p++;
+        switch (ch) {
+        case 'b': out_char(f, olen, '\b'); break;
+        case 'f': out_char(f, olen, '\f'); break;
+        case 'n': out_char(f, olen, '\n'); break;
+        case 'r': out_char(f, olen, '\r'); break;
+        case 't': out_char(f, olen, '\t'); break;
+        case 'u': {
+            unsigned cp = 0;
+            if (c->end - c->p < 4) {
+                return -1;
+            }
+            for (int i = 0; i < 4; i++) {
+                int v = hex_val(*c->p++);
+                if (v < 0) {
+                    return -1;
+                }
+                cp = cp << 4 | v;
+            }
+            if (cp < 0x80) {
+                out_char(f, olen, cp);
+            } else if (cp < 0x800) {
+                out_char(f, olen, 0xc0 | cp >> 6);
+                out_char(f, olen, 0x80 | (cp & 0x3f));
+            } else if (cp >= 0xd800 && cp < 0xe000) {
+                out_char(f, olen, '?');  // Surrogate halves are not needed by frp
+            } else {
+                out_char(f, olen, 0xe0 | cp >> 12);
+                out_char(f, olen, 0x80 | (cp >> 6 & 0x3f));
+                out_char(f, olen, 0x80 | (cp & 0x3f));
+            }
+            break;
+        }
+        default:   out_char(f, olen, ch); break;  // \" \\ \/
+        }
+    }
+    return -1;
+}
+
+/**
+ * Consume a non-string value: number, literal, or a nested object/array
+ * The raw text is copied to the field.
+ * @return 0 on success, -1 if malformed
+ */
+static int scan_raw(json_cursor_t *c, json_field_t *f, size_t *olen) {
+    int depth = 0;
+
+    while (c->p < c->end) {
+        char ch = *c->p;
+        if ('"' == ch) {
+            if (0 == depth) {
+                return -1;
+            }
+            const char *start = c->p;
+            if (scan_string(c, NULL, olen) < 0) {
+                return -1;
+            }
+            while (start < c->p) {
+                out_char(f, olen, *start++);
+            }
+            continue;
+        }
+        if ('{' == ch || '[' == ch) {
+            depth++;
+        } else if ('}' == ch || ']' == ch) {
+            if (0 == depth) {
+                return 0;  // End of the enclosing object
+            }
+            depth--;
+        } else if (0 == depth && (',' == ch || ' ' == ch || '\t' == ch || '\n' == ch || '\r' == ch)) {
+            return 0;
+        }
+        out_char(f, olen, ch);
+        c->p++;
+    }
+    return depth ? -1 : 0;
+}
+
+/**
+ * Pull named top-level fields out of a JSON object in one pass
+ * Unknown members are skipped without being stored; values longer than a
+ * field's buffer are truncated.
+ * @param json JSON text
+ * @param len Length of the text
+ * @param fields Fields to fill, out is "" for fields that are absent
+ * @param count Number of fields
+ * @return Number of fields found, -1 if the text is not a JSON object
+ */
+int json_extract(const char *json, size_t len, json_field_t *fields, int count) {
+    json_cursor_t c = { json, json + len };
+    int found = 0;
+
+    for (int i = 0; i < count; i++) {
+        fields[i].found = 0;
+        if (fields[i].size) {
+            fields[i].out[0] = '\0';
+        }
+    }
+
+    skip_ws(&c);
+    if (c.p >= c.end || '{' != *c.p++) {
+        return -1;
+    }
+    skip_ws(&c);
+    if (c.p < c.end && '}' == *c.p) {
+        return 0;
+    }
+
+    while (c.p < c.end) {
+        json_field_t *f = NULL;
+        size_t olen = 0;
+
+        // Key, frp keys carry no escapes so they are matched raw
+        if ('"' != *c.p) {
+            return -1;
+        }
+        const char *key = c.p + 1;
+        if (scan_string(&c, NULL, &olen) < 0) {
+            return -1;
+        }
+        size_t klen = c.p - 1 - key;
+        for (int i = 0; i < count; i++) {
+            if (!fields[i].found && 0 == strncmp(fields[i].key, key, klen) && '\0' == fields[i].key[klen]) {
+                f = &fields[i];
+                break;
+            }
+        }
+
+        skip_ws(&c);
+        if (c.p >= c.end || ':' != *c.p++) {
+            return -1;
+        }
+        skip_ws(&c);
+        if (c.p >= c.end) {
+            return -1;
+        }
+        if (f && 0 == f->size) {
+            f = NULL;
+        }
+        olen = 0;
+        if ('"' == *c.p ? scan_string(&c, f, &olen) : scan_raw(&c, f, &olen)) {
+            return -1;
+        }
+        if (f) {
+            f->out[olen] = '\0';
+            f->found = 1;
+            found++;
+        }
+
+        skip_ws(&c);
+        if (c.p >= c.end) {
+            return -1;
+        }
+        if ('}' == *c.p) {
+            return found;
+        }
+        if (',' != *c.p++) {
+            return -1;
+        }
+        skip_ws(&c);
+    }
+    return -1;
+}
@@ -0,0 +1,58 @@
+/********************************************************************\
+ * This program is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as   *
+ * published by the Free Software Foundation; either version 2 of   *
+ * the License, or (at your option) any later version.              *
+ *                                                                  *
+ * This program is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of   *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the    *
+ * GNU General Public License for more details.                     *
+ *                                                                  *
+ * You should have received a copy of the GNU General Public License*
+ * along with this program; if not, contact:                        *
+ *                                                                  *
+ * Free Software Foundation           Voice:  +1-617-542-5942       *
+ * 59 Temple Place - Suite 330        Fax:    +1-617-542-2652       *
+ * Boston, MA  02111-1307,  USA       gnu@gnu.org                   *
+ *                                                                  *
+\********************************************************************/
+
+/** @file minijson.h
+    @author Copyright (C) 2025 LYC <365256281@qq.com>
+*/
+
+#ifndef MINIJSON_H
+#define MINIJSON_H
+
+#include <stddef.h>
+
+// Fixed-shape JSON for frp control messages: the writer streams one flat
+// object into a caller buffer, the reader pulls named top-level fields out
+// in a single pass. Neither touches the heap.
+
+typedef struct json_writer {
+	char		*buf;
+	size_t		size;
+	size_t		len;
+	int			members;	// members written so far, for the comma
+	int			overflow;	// buffer too small, json_end() fails
+} json_writer_t;
+
+typedef struct json_field {
+	const char	*key;
+	char		*out;		// string value unescaped, other scalars as raw text
+	size_t		size;
+	int			found;
+} json_field_t;
+
+void   json_begin(json_writer_t *w, char *buf, size_t size);
+void   json_add_string(json_writer_t *w, const char *key, const char *val);
+void   json_add_int(json_writer_t *w, const char *key, long val);
+void   json_add_bool(json_writer_t *w, const char *key, int val);
+void   json_add_null(json_writer_t *w, const char *key);
+size_t json_end(json_writer_t *w);
+
+int    json_extract(const char *json, size_t len, json_field_t *fields, int count);
+
+#endif
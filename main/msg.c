@@ -26,22 +26,186 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
-#include <esp_system.h>
-#include <esp8266/esp_md5.h>
-#include "esp_system.h"
-#include "esp_system.h"
-#include "esp_log.h"
-#include "cJSON.h"
+#include "platform.h"
 #include "login.h"
 #include "control.h"
 #include "msg.h"
 #include "sntp.h"
 #include "crypto.h"
+#include "minijson.h"
 
 static const char *TAG = "msg";
 
+static uint8_t g_TxArena[MSG_TX_ARENA_SIZE];       // msg_hdr + payload of the message being sent
+static msg_tx_stat_t g_TxStats[MSG_TX_STATS_MAX];  // Per message type counters
+
 extern login_t *g_pLogin;
 extern MainConfig_t *g_pMainConf;
+extern struct frp_coder *encoder;
+
+static uint32_t g_TxHeapBefore;                    // Free heap when the arena was taken
+
+/**
+ * @brief Take the transmit arena to encode a message straight into it
+ * Only the main task sends on the control stream, so the arena and the
+ * encoder need no lock; finish with msg_tx_commit() or msg_tx_abort().
+ * @param capacity: Output, number of payload bytes the arena can hold
+ * @return Payload area
+ */
+char *msg_tx_begin(size_t *capacity)
+{
+    g_TxHeapBefore = plat_free_heap();
+    *capacity = MSG_TX_ARENA_SIZE - sizeof(msg_hdr_t);
+    return (char *)g_TxArena + sizeof(msg_hdr_t);
+}
+
+/**
+ * @brief Release the transmit arena without sending
+ */
+void msg_tx_abort(void)
+{
+}
+
+/**
+ * @brief Record one transmitted message in the per-type counters
+ * @param type: Message type
+ * @param len: Bytes placed on the stream (msg_hdr included)
+ * @param heap_used: Heap consumed while the message was encoded and sent
+ */
+static void msg_tx_account(char type, size_t len, uint32_t heap_used)
+{
+    for (int i = 0; i < MSG_TX_STATS_MAX; i++) {
+        msg_tx_stat_t *st = &g_TxStats[i];
+        if (st->type != type && st->type != 0) {
+            continue;
+        }
+        st->type = type;
+        st->count++;
+        st->bytes += len;
+        if (heap_used > st->peak_heap) {
+            st->peak_heap = heap_used;
+        }
+        return;
+    }
+}
+
+/**
+ * @brief Send the message encoded in the arena and release the arena
+ * The 9-byte msg_hdr is put in front of the payload, header and payload
+ * are encrypted in place when requested (AES-CFB allows it) and sent as
+ * one tcp mux frame. An encrypted message that cannot go out whole breaks
+ * the session, since frps could not decrypt anything after it.
+ * @param Sockfd: Socket file descriptor for communication
+ * @param type: Message type
+ * @param msg_len: Payload length, 0 if encoding failed
+ * @param stream: Pointer to tmux stream structure for I/O operations
+ * @param encrypt: Non-zero to encrypt header and payload
+ * @return _SUCCESS(0)/_FAIL(1) on operation result
+ */
+int msg_tx_commit(int Sockfd, const char type, size_t msg_len, tmux_stream_t *stream, int encrypt)
+{
+    struct iovec iov[3];
+    int iovcnt = 1;
+    const uint8_t *iv = NULL;
+    msg_hdr_t *req_msg = (msg_hdr_t *)g_TxArena;
+    size_t len = msg_len + sizeof(msg_hdr_t);
+    uint32_t heap_low, heap_now;
+    int ret = _FAIL;
+    int err;
+
+    if (0 == msg_len) {
+        ESP_LOGE(TAG, "error: msg %c could not be encoded", type);
+        goto out;
+    }
+    if (Sockfd < 0) {
+        ESP_LOGE(TAG, "error: send_msg_frp_server failed, Sockfd < 0");
+        goto out;
+    }
+    if (encrypt && NULL == encoder) {
+        ESP_LOGE(TAG, "error: msg %c needs the encoder, not set up yet", type);
+        goto out;
+    }
+    if (!encrypt) {
+        ESP_LOGE(TAG, "send plain msg ----> [%c: %.*s]", type, (int)msg_len, req_msg->data);
+    }
+
+    // Encrypting advances the AES-CFB stream and uses up the one-time IV,
+    // so the frame must be sure to go out whole before a byte is encrypted
+    if (!tmux_stream_writable(stream, len + (encrypt && crypto_encoder_iv_pending() ? AES_128_IV_SIZE : 0))) {
+        ESP_LOGE(TAG, "error: msg %c of %u bytes does not fit stream %u (window %u)",
+                 type, (uint)len, stream->id, stream->send_window);
+        if (encrypt) {
+            mark_session_broken();  // Dropping it would leave a gap in the encrypted stream
+        }
+        goto out;
+    }
+
+    req_msg->type = type;
+    req_msg->length = ntoh64((uint64_t)msg_len);  // Convert to network byte order
+
+    if (encrypt) {
+        err = my_aes_encrypt_stream(g_TxArena, len);  // In place
+        if (0 != err) {
+            ESP_LOGE(TAG, "error: msg %c encryption failed: -0x%x", type, -err);
+            mark_session_broken();  // Never send the plaintext, and the encoder state is unknown
+            goto out;
+        }
+        iv = crypto_take_encoder_iv();
+    }
+    heap_low = plat_free_heap();
+
+    // Send through TMUX stream, iov[0] carries the tcp mux header and the
+    // encoder IV shares the frame with the first encrypted message
+    if (iv) {
+        iov[iovcnt].iov_base = (void *)iv;
+        iov[iovcnt++].iov_len = AES_128_IV_SIZE;
+    }
+    iov[iovcnt].iov_base = g_TxArena;
+    iov[iovcnt++].iov_len = len;
+    int sent = tmux_stream_writev(Sockfd, iov, iovcnt, stream);
+    if (iv) {
+        sent -= AES_128_IV_SIZE;
+    }
+    if (sent == (int)len) {
+        ret = _SUCCESS;
+    } else {
+        ESP_LOGE(TAG, "error: msg %c not fully sent (%d/%u)", type, sent, (uint)len);
+        if (encrypt) {
+            mark_session_broken();  // The encoder has moved past bytes frps never got
+        }
+    }
+
+    heap_now = plat_free_heap();
+    if (heap_now < heap_low) {
+        heap_low = heap_now;
+    }
+    msg_tx_account(type, len, g_TxHeapBefore > heap_low ? g_TxHeapBefore - heap_low : 0);
+
+out:
+    return ret;
+}
+
+/**
+ * @brief Copy a ready-made payload into the arena and send it
+ * @return _SUCCESS(0)/_FAIL(1) on operation result
+ */
+static int msg_tx_send(int Sockfd, const char type, const char *pmsg, size_t msg_len,
+                       tmux_stream_t *stream, int encrypt)
+{
+    size_t capacity;
+    char *payload = msg_tx_begin(&capacity);
+
+    if (NULL == payload) {
+        return _FAIL;
+    }
+    if (msg_len > capacity) {
+        ESP_LOGE(TAG, "error: msg %c of %u bytes exceeds tx arena", type, (uint)msg_len);
+        msg_tx_abort();
+        return _FAIL;
+    }
+    memcpy(payload, pmsg, msg_len);
+    return msg_tx_commit(Sockfd, type, msg_len, stream, encrypt);
+}
 
 /**
  * @brief Send plain text message to FRP server
@@ -50,7 +214,7 @@ extern MainConfig_t *g_pMainConf;
  * @param pmsg: Pointer to message payload data
  * @param msg_len: Length of message payload
  * @param stream: Pointer to tmux stream structure for I/O operations
- * @return _SUCCESS(1)/_FAIL(0) on operation result
+ * @return _SUCCESS(0)/_FAIL(1) on operation result
  */
 int send_msg_frp_server(int Sockfd, 
                      const msg_type_t type, 
@@ -58,31 +222,7 @@ int send_msg_frp_server(int Sockfd,
                      const uint msg_len, 
                      tmux_stream_t *stream)
 {
-    if (Sockfd < 0) {
-        ESP_LOGE(TAG, "error: send_msg_frp_server failed, Sockfd < 0");
-        return 0;
-    }
-    ESP_LOGE(TAG, "send plain msg ----> [%c: %s]", type, pmsg);
-    
-    // Allocate memory for message header + payload
-    size_t len = msg_len + sizeof(msg_hdr_t);
-    msg_hdr_t *req_msg = calloc(len, 1);
-    
-    if (NULL == req_msg) {
-        ESP_LOGE(TAG, "error: req_msg init failed");
-        return _FAIL;
-    }   
-    
-    // Construct message header
-    req_msg->type = type;
-    req_msg->length = ntoh64((uint64_t)msg_len);  // Convert to network byte order
-    memcpy(req_msg->data, pmsg, msg_len);          // Copy payload
-    
-    // Send through TMUX stream
-    tmux_stream_write(Sockfd, (char *)req_msg, len, stream);
-    free(req_msg);
-
-    return _SUCCESS;
+    return msg_tx_send(Sockfd, type, pmsg, msg_len, stream, 0);
 }
 
 /**
@@ -92,49 +232,63 @@ int send_msg_frp_server(int Sockfd,
  * @param msg: Pointer to message payload data
  * @param msg_len: Length of message payload
  * @param stream: Pointer to tmux stream structure for I/O operations
+ * @return _SUCCESS on success, _FAIL on failure
  */
-void send_enc_msg_frp_server(int Sockfd,
+int send_enc_msg_frp_server(int Sockfd,
              const enum msg_type type, 
              const char *msg, 
              const size_t msg_len, 
              struct tmux_stream *stream)
 {
-    size_t ct_len;
-    
-    if (Sockfd < 0) {
-        ESP_LOGE(TAG, "error: send_msg_frp_server failed, Sockfd < 0");
-        return;
-    }
-
-    // Create message header + payload
-    struct msg_hdr *req_msg = calloc(msg_len+sizeof(struct msg_hdr), 1);
-    assert(req_msg);
-    req_msg->type = type;
-    req_msg->length = ntoh64((uint64_t)msg_len);
-    memcpy(req_msg->data, msg, msg_len);
+    return msg_tx_send(Sockfd, type, msg, msg_len, stream, 1);
+}
 
-    // Encrypt the entire message
-    uint8_t *enc_msg = calloc(msg_len+sizeof(struct msg_hdr), 1);
-    my_aes_encrypt((uint8_t *)req_msg, msg_len+sizeof(struct msg_hdr), enc_msg, &ct_len);
+/**
+ * @brief Get the per-message-type transmit counters
+ * @param count: Output, number of valid entries
+ * @return Pointer to the counter table
+ */
+const msg_tx_stat_t *msg_get_tx_stats(int *count)
+{
+    int n = 0;
+    while (n < MSG_TX_STATS_MAX && g_TxStats[n].type) {
+        n++;
+    }
+    *count = n;
+    return g_TxStats;
+}
 
-    // Send encrypted data
-    tmux_stream_write(Sockfd, (char*)enc_msg, ct_len, stream);  
+/**
+ * @brief Log the per-message-type transmit counters
+ */
+void msg_dump_tx_stats(void)
+{
+    int count;
+    const msg_tx_stat_t *st = msg_get_tx_stats(&count);
 
-    // Cleanup resources
-    free(enc_msg);    
-    free(req_msg);
+    for (int i = 0; i < count; i++) {
+        ESP_LOGI(TAG, "tx msg %c: count %u bytes %u peak heap %u",
+                 st[i].type, st[i].count, st[i].bytes, st[i].peak_heap);
+    }
 }
 
 /**
  * Generate authentication key using MD5 hash
  * @param token Authentication token (can be NULL)
  * @param timestamp Output parameter for current timestamp
- * @return MD5 hash string (needs to be freed by caller)
+ * @param key Output, MD5 hex string
+ * @return _SUCCESS, _FAIL without valid time
  */
-char * get_auth_key(const char *token, int *timestamp)
+int get_auth_key(const char *token, int *timestamp, char key[33])
 {
     char seed[128] = {0};
-    *timestamp = obtain_time();  // Get current timestamp
+    time_t now;
+
+    if (_SUCCESS != clock_get_time(&now)) {
+        ESP_LOGE(TAG, "error: no valid time for the auth key yet");
+        return _FAIL;            // Login must be retried once the clock is valid
+    }
+    *timestamp = (int)now;
     
     // Create seed string: token + timestamp or just timestamp
     if (token)
@@ -142,253 +296,143 @@ char * get_auth_key(const char *token, int *timestamp)
     else
         snprintf(seed, 128, "%d", *timestamp);
     
-    return calc_md5(seed, strlen(seed));  // Calculate MD5 of seed
+    calc_md5(seed, strlen(seed), key);  // Calculate MD5 of seed
+    return _SUCCESS;
 }
 
 /**
  * Marshal login request to JSON format
- * @param msg Output parameter for generated JSON string
+ * @param buf Output buffer, normally the transmit arena from msg_tx_begin()
+ * @param size Size of buf
  * @return Length of generated JSON string (0 on failure)
  */
-uint32_t login_request_marshal(char **msg) 
+uint32_t login_request_marshal(char *buf, size_t size) 
 {
-    uint32_t nret = 0;
-    uint32_t freeHeap;
-    *msg = NULL;
+    json_writer_t w;
 
-    // Free existing privilege key
-    SAFE_FREE(g_pLogin->privilege_key);
-    
     // Generate new authentication key
-    char *auth_key = get_auth_key(g_pMainConf->auth_token, &g_pLogin->timestamp);
-    if (!auth_key) {
+    if (_SUCCESS != get_auth_key(g_pMainConf->auth_token, &g_pLogin->timestamp, g_pLogin->privilege_key)) {
         ESP_LOGE(TAG, "get_auth_key fail");
         return 0;
     }
-    
-    // Store new privilege key
-    g_pLogin->privilege_key = strdup(auth_key);
-    if (!g_pLogin->privilege_key) {
-        ESP_LOGE(TAG, "privilege_key fail");
-        SAFE_FREE(auth_key);
-        return 0;
-    }
-
-    // Create JSON object for login request
-    cJSON *j_login_req = cJSON_CreateObject();
-    if (!j_login_req) {
-        ESP_LOGE(TAG, "cJSON_CreateObject fail");
-        SAFE_FREE(auth_key);
-        return 0;
-    }
-    
-    // Add all required fields to JSON
-    freeHeap = esp_get_free_heap_size();
-    ESP_LOGE(TAG, "Free Heap: %u bytes\n", freeHeap);
-    
-    cJSON_AddStringToObject(j_login_req, "version", SAFE_JSON_STRING(g_pLogin->version));
-    cJSON_AddStringToObject(j_login_req, "hostname", SAFE_JSON_STRING(g_pLogin->hostname));
-    cJSON_AddStringToObject(j_login_req, "os", SAFE_JSON_STRING(g_pLogin->os));
-    cJSON_AddStringToObject(j_login_req, "arch", SAFE_JSON_STRING(g_pLogin->arch));
-    cJSON_AddStringToObject(j_login_req, "user", SAFE_JSON_STRING(g_pLogin->user));
-    cJSON_AddStringToObject(j_login_req, "privilege_key", SAFE_JSON_STRING(g_pLogin->privilege_key));
-    
-    char buf[32] = {0};
-    sprintf(buf , "%d" , g_pLogin->timestamp);
-    cJSON_AddRawToObject(j_login_req, "timestamp", buf);
-    cJSON_AddStringToObject(j_login_req, "run_id", SAFE_JSON_STRING(g_pLogin->run_id));
-    sprintf(buf , "%d" , g_pLogin->pool_count);
-    cJSON_AddRawToObject(j_login_req, "pool_count", buf);
-    cJSON_AddNullToObject(j_login_req, "metas");
-    
-    // Generate JSON string
-    char *tmp = cJSON_PrintUnformatted(j_login_req);
-    ESP_LOGE(TAG, "tmp = %p\n", tmp);
-    if (tmp && strlen(tmp) > 0) {
-        nret = strlen(tmp);
-        *msg = strdup(tmp);
-        if (!*msg) {
-            nret = 0;
-        }
-    }
 
-    // Cleanup resources
-    if (tmp) {
-        cJSON_free(tmp);
-    }
-    cJSON_Delete(j_login_req);
-    SAFE_FREE(auth_key);
-    return nret;
+    json_begin(&w, buf, size);
+    json_add_string(&w, "version", SAFE_JSON_STRING(g_pLogin->version));
+    json_add_string(&w, "hostname", SAFE_JSON_STRING(g_pLogin->hostname));
+    json_add_string(&w, "os", SAFE_JSON_STRING(g_pLogin->os));
+    json_add_string(&w, "arch", SAFE_JSON_STRING(g_pLogin->arch));
+    json_add_string(&w, "user", SAFE_JSON_STRING(g_pLogin->user));
+    json_add_string(&w, "privilege_key", g_pLogin->privilege_key);
+    json_add_int(&w, "timestamp", g_pLogin->timestamp);
+    json_add_string(&w, "run_id", SAFE_JSON_STRING(g_pLogin->run_id));
+    json_add_int(&w, "pool_count", g_pLogin->pool_count);
+    json_add_null(&w, "metas");
+    return json_end(&w);
 }
 
 /**
  * Calculate MD5 hash of input data
  * @param data Input data buffer
  * @param datalen Length of input data
- * @return MD5 hash string (33-byte buffer with null terminator)
+ * @param out Output, MD5 hex string with null terminator
  */
-char * calc_md5(const char *data, int datalen) {
+void calc_md5(const char *data, int datalen, char out[33]) {
     unsigned char digest[16] = {0};
-    char *out = malloc(33);
-    if (NULL == out) {
-        return NULL;
-    }
 
     // Calculate MD5 hash
-    struct MD5Context md5;
-    esp_md5_init(&md5);
-    esp_md5_update(&md5, (const uint8_t *)data, datalen);
-    esp_md5_final(&md5, digest);
+    plat_md5((const uint8_t *)data, datalen, digest);
     
     // Convert to hex string
     for (int n = 0; n < 16; ++n) {
         snprintf(&(out[n*2]), 3, "%02x", (unsigned int)digest[n]);
     }
     out[32] = '\0';
-
-    return out;
 }
 
 /**
  * @brief Unmarshal login response JSON into structure
- * @param jres: Pointer to JSON response string
- * @return Pointer to login_resp structure (needs free()), NULL on failure
+ * @param jres: Login response JSON
+ * @param len: Length of the JSON text
+ * @param lr: Output, fields frps did not send are ""
+ * @return _SUCCESS, _FAIL if version or run_id is missing
  */
-struct login_resp* login_resp_unmarshal(const char* jres) 
+int login_resp_unmarshal(const char *jres, size_t len, struct login_resp *lr)
 {
-    	struct login_resp* lr = (struct login_resp*)calloc(1, sizeof(struct login_resp));
-    	if (NULL == lr) {
-        	return NULL;
-    	}
-
-    	cJSON* j_lg_res = cJSON_Parse(jres);
-    	if (NULL == j_lg_res) {
-        	free(lr);
-        	return NULL;
-    	}
-
-    	cJSON* l_version = cJSON_GetObjectItem(j_lg_res, "version");
-    	if (!cJSON_IsString(l_version)) {
-        	goto END_ERROR;
-    	}
-    	lr->version = strdup(l_version->valuestring);
-
-    	cJSON* l_run_id = cJSON_GetObjectItem(j_lg_res, "run_id");
-    	if (!cJSON_IsString(l_run_id)) {
-        	goto END_ERROR;
-    	}
-    	lr->run_id = strdup(l_run_id->valuestring);
-    	cJSON_Delete(j_lg_res);
-    	return lr;
-
-END_ERROR:
-    	cJSON_Delete(j_lg_res);
-    	free(lr);
-    	return NULL;
+    json_field_t fields[] = {
+        { .key = "version", .out = lr->version, .size = sizeof(lr->version) },
+        { .key = "run_id",  .out = lr->run_id,  .size = sizeof(lr->run_id) },
+        { .key = "error",   .out = lr->error,   .size = sizeof(lr->error) },
+    };
+
+    if (json_extract(jres, len, fields, 3) < 0 || !fields[0].found || !fields[1].found) {
+        return _FAIL;
+    }
+    return _SUCCESS;
+}
+
+/**
+ * @brief Unmarshal frps's NewProxyResp
+ * @param jres: NewProxyResp JSON
+ * @param len: Length of the JSON text
+ * @param npr: Output, error is "" when frps registered the proxy
+ * @return _SUCCESS, _FAIL if the response is malformed
+ */
+int new_proxy_resp_unmarshal(const char *jres, size_t len, struct new_proxy_resp *npr)
+{
+    json_field_t fields[] = {
+        { .key = "proxy_name",  .out = npr->proxy_name,  .size = sizeof(npr->proxy_name) },
+        { .key = "remote_addr", .out = npr->remote_addr, .size = sizeof(npr->remote_addr) },
+        { .key = "error",       .out = npr->error,       .size = sizeof(npr->error) },
+    };
+
+    if (json_extract(jres, len, fields, 3) < 0) {
+        return _FAIL;
+    }
+    return _SUCCESS;
 }
 
 /**
  * @brief Marshal new proxy service configuration into JSON
  * @param np_req: Pointer to proxy service configuration structure
- * @param msg: Pointer to store generated JSON string (needs free())
- * @return 1 on success, 0 on failure
+ * @param buf: Output buffer, normally the transmit arena from msg_tx_begin()
+ * @param size: Size of buf
+ * @return Length of JSON string on success, 0 on failure
  */
-int new_proxy_service_marshal(const struct proxy_service *np_req, char **msg)
+int new_proxy_service_marshal(const struct proxy_service *np_req, char *buf, size_t size)
 {
-    	char *tmp = NULL;
-    	int nret = 0;
-    
-    	if (!np_req || !msg) {
-        	//printf("Error: Invalid input\n");
-        	return 0;
-    	}
-    
-     	cJSON *j_np_req = cJSON_CreateObject();
-    	if (!j_np_req) {
-        	//printf("\r\ncJSON_CreateObject fail\r\n");
-        	return 0;
-    	}
-    
-    	if (np_req->proxy_name) {
-        	//printf("Add proxy_name: %s\n", np_req->proxy_name);
-        	cJSON_AddStringToObject(j_np_req, "proxy_name", np_req->proxy_name);
-    	} else {
-        	cJSON_AddNullToObject(j_np_req, "proxy_name");
-    	}
-    
-    	if (np_req->proxy_type) {
-        	//printf("Add proxy_type: %s\n", np_req->proxy_type);
-        	cJSON_AddStringToObject(j_np_req, "proxy_type", np_req->proxy_type);
-    	} else {
-        	cJSON_AddNullToObject(j_np_req, "proxy_type");
-    	}
-
-    	cJSON_AddBoolToObject(j_np_req, "use_encryption", np_req->use_encryption);
-    	cJSON_AddBoolToObject(j_np_req, "use_compression", np_req->use_compression);
-    
-    	char buffer[32];
-    	if (np_req->remote_port != -1) {
-        	snprintf(buffer, sizeof(buffer), "%d", np_req->remote_port);
-        	cJSON_AddRawToObject(j_np_req, "remote_port", buffer);
-        	//printf("Add remote_port: %d\n", np_req->remote_port);
-    	} else {
-        	cJSON_AddNullToObject(j_np_req, "remote_port");
-    	}
-    
-    	tmp = cJSON_Print(j_np_req);
-
-    	if (!tmp) {
-        	//printf("Error: Failed to print JSON (out of memory)\n");
-        	cJSON_Delete(j_np_req);
-        	return 0;
-    	}
-
-    	if (tmp && strlen(tmp) > 0) {
-        	nret = strlen(tmp);
-        	*msg = (char *)malloc(nret + 1);
-        	if (*msg) {
-            		strcpy(*msg, tmp);
-        	} else {
-            		nret = 0;
-        	}
-    	}
-    
-    	free((void *)tmp);
-    	cJSON_Delete(j_np_req);
-    
-    	return nret;
+    json_writer_t w;
+
+    if (!np_req) {
+        return 0;
+    }
+
+    json_begin(&w, buf, size);
+    json_add_string(&w, "proxy_name", np_req->proxy_name);
+    json_add_string(&w, "proxy_type", np_req->proxy_type);
+    json_add_bool(&w, "use_encryption", np_req->use_encryption);
+    json_add_bool(&w, "use_compression", np_req->use_compression);
+    if (np_req->remote_port != -1) {
+        json_add_int(&w, "remote_port", np_req->remote_port);
+    } else {
+        json_add_null(&w, "remote_port");
+    }
+    return json_end(&w);
 }
 
 /**
  * @brief Marshal new work connection information into JSON
  * @param work_c: Pointer to work connection structure
- * @param msg: Pointer to store generated JSON string (needs free())
+ * @param buf: Output buffer, normally the transmit arena from msg_tx_begin()
+ * @param size: Size of buf
  * @return Length of JSON string on success, 0 on failure
  */
-int new_work_conn_marshal(const struct work_conn *work_c, char **msg) 
+int new_work_conn_marshal(const struct work_conn *work_c, char *buf, size_t size) 
 {
-    	int nret = 0;
-    	cJSON *j_new_work_conn = cJSON_CreateObject();
-    	if (!j_new_work_conn) {
-        	return 0;
-    	}
-
-    	// Add the run_id to the JSON object
-    	cJSON_AddStringToObject(j_new_work_conn, "run_id", work_c->run_id ? work_c->run_id : "");
-
-    	// Convert the cJSON object to a JSON string
-    	char *tmp = cJSON_PrintUnformatted(j_new_work_conn);
-    	if (tmp && strlen(tmp) > 0) {
-        	nret = strlen(tmp);
-        	*msg = strdup(tmp);
-        	assert(*msg);
-    	}
-
-    	// Clean up
-    	cJSON_Delete(j_new_work_conn);
-    	free(tmp);
-
-    	return nret;
+    json_writer_t w;
+
+    json_begin(&w, buf, size);
+    json_add_string(&w, "run_id", SAFE_JSON_STRING(work_c->run_id));
+    return json_end(&w);
 }
 
 /**
@@ -40,16 +40,36 @@ struct work_conn {
 	char *run_id;
 };
 
+struct login_resp;
 
-char * calc_md5(const char *data, int datalen);
+struct new_proxy_resp {
+	char	proxy_name[64];
+	char	remote_addr[32];
+	char	error[128];
+};
+
+#define MSG_TX_ARENA_SIZE	1024	// largest msg_hdr + payload sent on the control stream
+#define MSG_TX_STATS_MAX	8		// distinct message types tracked
+
+typedef struct msg_tx_stat {
+	char		type;
+	uint32_t	count;
+	uint32_t	bytes;
+	uint32_t	peak_heap;	// largest heap drop seen while encoding and sending one message
+} msg_tx_stat_t;
+
+
+void calc_md5(const char *data, int datalen, char out[33]);
 
-char * get_auth_key(const char *token, int *timestamp);
+int get_auth_key(const char *token, int *timestamp, char key[33]);
 
-uint login_request_marshal(char **msg);
+uint login_request_marshal(char *buf, size_t size);
 
-struct login_resp* login_resp_unmarshal(const char *jres);
+int login_resp_unmarshal(const char *jres, size_t len, struct login_resp *lr);
 
-int new_proxy_service_marshal(const struct proxy_service *np_req, char **msg);
+int new_proxy_service_marshal(const struct proxy_service *np_req, char *buf, size_t size);
+
+int new_proxy_resp_unmarshal(const char *jres, size_t len, struct new_proxy_resp *npr);
 
 int send_msg_frp_server(int Sockfd,  //req_msg : type = TypeLogin'o' lenth data
                     			const msg_type_t type, 
@@ -58,13 +78,23 @@ int send_msg_frp_server(int Sockfd,  //req_msg : type = TypeLogin'o' lenth data
                     			tmux_stream_t *stream);
 
 
-void send_enc_msg_frp_server(int Sockfd,
+int send_enc_msg_frp_server(int Sockfd,
 			 const enum msg_type type, 
 			 const char *msg, 
 			 const size_t msg_len, 
 			 struct tmux_stream *stream);
 
-int new_work_conn_marshal(const struct work_conn *work_c, char **msg);
+int new_work_conn_marshal(const struct work_conn *work_c, char *buf, size_t size);
+
+char *msg_tx_begin(size_t *capacity);
+
+int msg_tx_commit(int Sockfd, const char type, size_t msg_len, tmux_stream_t *stream, int encrypt);
+
+void msg_tx_abort(void);
+
+const msg_tx_stat_t *msg_get_tx_stats(int *count);
+
+void msg_dump_tx_stats(void);
 
 uint64_t ntoh64(const uint64_t input);
 
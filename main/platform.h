@@ -0,0 +1,101 @@
+/********************************************************************\
+ * This program is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as   *
+ * published by the Free Software Foundation; either version 2 of   *
+ * the License, or (at your option) any later version.              *
+ *                                                                  *
+ * This program is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of   *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the    *
+ * GNU General Public License for more details.                     *
+ *                                                                  *
+ * You should have received a copy of the GNU General Public License*
+ * along with this program; if not, contact:                        *
+ *                                                                  *
+ * Free Software Foundation           Voice:  +1-617-542-5942       *
+ * 59 Temple Place - Suite 330        Fax:    +1-617-542-2652       *
+ * Boston, MA  02111-1307,  USA       gnu@gnu.org                   *
+ *                                                                  *
+\********************************************************************/
+
+/** @file platform.h
+    @author Copyright (C) 2025 LYC <365256281@qq.com>
+*/
+
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Thin platform layer for the protocol core (tcpmux, msg, crypto, control,
+// reactor, login). On the device it maps onto lwip, FreeRTOS and the ESP
+// SDK; host/platform_linux.c implements it over POSIX for the native build.
+
+#ifdef ESP_PLATFORM
+
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "lwip/err.h"
+#include "lwip/sockets.h"
+#include "lwip/sys.h"
+#include <lwip/netdb.h>
+
+#else
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+typedef int esp_err_t;
+#define ESP_OK		0
+#define ESP_FAIL	-1
+
+void plat_log(char level, const char *tag, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+
+#define ESP_LOGE(tag, fmt, ...)	plat_log('E', tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...)	plat_log('W', tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...)	plat_log('I', tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...)	plat_log('D', tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGV(tag, fmt, ...)	plat_log('V', tag, fmt, ##__VA_ARGS__)
+
+#define inet_ntoa_r(addr, buf, len)	inet_ntop(AF_INET, &(addr), buf, len)
+
+#endif //ESP_PLATFORM
+
+// Time
+uint32_t plat_now_ms(void);			// monotonic, wraps after ~49 days
+int64_t  plat_now_us(void);			// monotonic, for latency measurements
+void     plat_sleep_ms(uint32_t ms);
+
+// System
+uint32_t plat_random(void);
+uint32_t plat_free_heap(void);
+void     plat_restart(void);
+int      plat_read_mac(uint8_t mac[6]);
+void     plat_md5(const uint8_t *data, size_t len, uint8_t digest[16]);
+void     plat_gpio_set(int pin, int level);
+
+// Persistent key/value storage
+int      plat_nvs_get_blob(const char *ns, const char *key, void *buf, size_t *len);
+int      plat_nvs_set_blob(const char *ns, const char *key, const void *buf, size_t len);
+
+// Memory that survives a reset but not a power cycle, addressed in bytes
+// from the start of the application's share; offsets and sizes are 4 byte
+// multiples
+#define PLAT_RTC_CLOCK		0		// sntp.c last known time, 16 bytes
+#define PLAT_RTC_BOOT		32		// config.c mode for the next boot, 8 bytes
+
+int      plat_rtc_load(uint32_t offset, void *buf, size_t len);
+int      plat_rtc_store(uint32_t offset, const void *buf, size_t len);
+
+#endif //PLATFORM_H
@@ -0,0 +1,157 @@
+/********************************************************************\
+ * This program is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as   *
+ * published by the Free Software Foundation; either version 2 of   *
+ * the License, or (at your option) any later version.              *
+ *                                                                  *
+ * This program is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of   *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the    *
+ * GNU General Public License for more details.                     *
+ *                                                                  *
+ * You should have received a copy of the GNU General Public License*
+ * along with this program; if not, contact:                        *
+ *                                                                  *
+ * Free Software Foundation           Voice:  +1-617-542-5942       *
+ * 59 Temple Place - Suite 330        Fax:    +1-617-542-2652       *
+ * Boston, MA  02111-1307,  USA       gnu@gnu.org                   *
+ *                                                                  *
+\********************************************************************/
+
+/** @file platform_esp.c
+    @author Copyright (C) 2025 LYC <365256281@qq.com>
+*/
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "driver/gpio.h"
+#include <esp8266/esp_md5.h>
+#include "login.h"
+#include "tcpmux.h"
+#include "platform.h"
+
+/**
+ * Milliseconds since boot
+ */
+uint32_t plat_now_ms(void) {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+/**
+ * Microseconds since boot
+ */
+int64_t plat_now_us(void) {
+    return esp_timer_get_time();
+}
+
+/**
+ * Block the calling task, always yields for at least one tick
+ * @param ms Delay in milliseconds
+ */
+void plat_sleep_ms(uint32_t ms) {
+    TickType_t ticks = pdMS_TO_TICKS(ms);
+    vTaskDelay(ticks ? ticks : 1);
+}
+
+uint32_t plat_random(void) {
+    return esp_random();
+}
+
+uint32_t plat_free_heap(void) {
+    return esp_get_free_heap_size();
+}
+
+void plat_restart(void) {
+    esp_restart();
+}
+
+/**
+ * Read the WiFi station MAC address
+ * @param mac Output address
+ * @return _SUCCESS on success, _FAIL otherwise
+ */
+int plat_read_mac(uint8_t mac[6]) {
+    return ESP_OK == esp_read_mac(mac, ESP_MAC_WIFI_STA) ? _SUCCESS : _FAIL;
+}
+
+void plat_md5(const uint8_t *data, size_t len, uint8_t digest[16]) {
+    struct MD5Context md5;
+
+    esp_md5_init(&md5);
+    esp_md5_update(&md5, data, len);
+    esp_md5_final(&md5, digest);
+}
+
+void plat_gpio_set(int pin, int level) {
+    gpio_set_level(pin, level);
+}
+
+/**
+ * Read a blob from NVS
+ * @param ns NVS namespace
+ * @param key Key
+ * @param buf Output buffer
+ * @param len In: buffer size, out: blob size
+ * @return _SUCCESS on success, _FAIL if missing or too large
+ */
+int plat_nvs_get_blob(const char *ns, const char *key, void *buf, size_t *len) {
+    nvs_handle handle;
+
+    if (ESP_OK != nvs_open(ns, NVS_READONLY, &handle)) {
+        return _FAIL;
+    }
+    esp_err_t err = nvs_get_blob(handle, key, buf, len);
+    nvs_close(handle);
+    return ESP_OK == err ? _SUCCESS : _FAIL;
+}
+
+/**
+ * Write and commit a blob to NVS
+ * @param ns NVS namespace
+ * @param key Key
+ * @param buf Data
+ * @param len Data size
+ * @return _SUCCESS on success, _FAIL otherwise
+ */
+int plat_nvs_set_blob(const char *ns, const char *key, const void *buf, size_t len) {
+    nvs_handle handle;
+
+    if (ESP_OK != nvs_open(ns, NVS_READWRITE, &handle)) {
+        return _FAIL;
+    }
+    esp_err_t err = nvs_set_blob(handle, key, buf, len);
+    if (ESP_OK == err) {
+        err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    return ESP_OK == err ? _SUCCESS : _FAIL;
+}
+
+// First RTC memory block left to applications, the SDK owns the ones below
+#define RTC_USER_BLOCK	64
+
+/**
+ * Read from RTC user memory
+ * @param offset Byte offset, a multiple of 4 (PLAT_RTC_*)
+ * @param buf Output buffer
+ * @param len Bytes to read, a multiple of 4
+ * @return _SUCCESS on success, _FAIL otherwise
+ */
+int plat_rtc_load(uint32_t offset, void *buf, size_t len) {
+    return system_rtc_mem_read(RTC_USER_BLOCK + offset / 4, buf, len) ? _SUCCESS : _FAIL;
+}
+
+/**
+ * Write to RTC user memory
+ * @param offset Byte offset, a multiple of 4 (PLAT_RTC_*)
+ * @param buf Data
+ * @param len Bytes to write, a multiple of 4
+ * @return _SUCCESS on success, _FAIL otherwise
+ */
+int plat_rtc_store(uint32_t offset, const void *buf, size_t len) {
+    return system_rtc_mem_write(RTC_USER_BLOCK + offset / 4, buf, len) ? _SUCCESS : _FAIL;
+}
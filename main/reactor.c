@@ -0,0 +1,340 @@
+/********************************************************************\
+ * This program is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as   *
+ * published by the Free Software Foundation; either version 2 of   *
+ * the License, or (at your option) any later version.              *
+ *                                                                  *
+ * This program is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of   *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the    *
+ * GNU General Public License for more details.                     *
+ *                                                                  *
+ * You should have received a copy of the GNU General Public License*
+ * along with this program; if not, contact:                        *
+ *                                                                  *
+ * Free Software Foundation           Voice:  +1-617-542-5942       *
+ * 59 Temple Place - Suite 330        Fax:    +1-617-542-2652       *
+ * Boston, MA  02111-1307,  USA       gnu@gnu.org                   *
+ *                                                                  *
+\********************************************************************/
+
+/** @file reactor.c
+    @author Copyright (C) 2025 LYC <365256281@qq.com>
+*/
+
+#include <string.h>
+#include "platform.h"
+#include "login.h"
+#include "tcpmux.h"
+#include "reactor.h"
+
+static const char *TAG = "reactor";
+
+typedef struct reactor_watch {
+	int					fd;			// -1 when the slot is free
+	int					events;
+	uint32_t			epoch;		// iteration the watch was added in
+	reactor_io_cb_t		cb;
+	void				*arg;
+} reactor_watch_t;
+
+static reactor_watch_t g_watches[REACTOR_MAX_FDS];
+static int g_nwatches = 0;                              // Slots in use are [0, g_nwatches)
+static reactor_timer_t *g_wheel[REACTOR_WHEEL_SLOTS];
+static uint32_t g_wheel_pos = 0;                        // Slot of the last tick run
+static reactor_timer_t *g_expiring = NULL;              // Rest of the slot being run, detached from the wheel
+static uint32_t g_wheel_ms = 0;                         // Time the wheel was last advanced to
+static uint32_t g_ntimers = 0;
+static uint32_t g_epoch = 0;
+static reactor_stats_t g_stats;
+
+/**
+ * Find the watch registered for a socket
+ * @param fd Socket descriptor
+ * @return Watch, NULL if the socket is not registered
+ */
+static reactor_watch_t *find_watch(int fd) {
+    for (int i = 0; i < g_nwatches; i++) {
+        if (g_watches[i].fd == fd) {
+            return &g_watches[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Register a socket with the reactor
+ * @param fd Socket descriptor
+ * @param events REACTOR_READ and/or REACTOR_WRITE
+ * @param cb Called with the ready events
+ * @param arg Passed to cb
+ * @return _SUCCESS on success, _FAIL if the watch table is full
+ */
+int reactor_add(int fd, int events, reactor_io_cb_t cb, void *arg) {
+    reactor_watch_t *w = find_watch(fd);
+
+    if (NULL == w) {
+        if (REACTOR_MAX_FDS == g_nwatches) {
+            ESP_LOGE(TAG, "error: watch table full, fd %d not added", fd);
+            return _FAIL;
+        }
+        w = &g_watches[g_nwatches++];
+    }
+    w->fd = fd;
+    w->events = events;
+    w->epoch = g_epoch;     // Readiness from this iteration's select() is not for us
+    w->cb = cb;
+    w->arg = arg;
+    return _SUCCESS;
+}
+
+/**
+ * Change the events a socket is watched for
+ * @param fd Socket descriptor
+ * @param events REACTOR_READ and/or REACTOR_WRITE, 0 to pause the watch
+ */
+void reactor_mod(int fd, int events) {
+    reactor_watch_t *w = find_watch(fd);
+    if (w) {
+        w->events = events;
+    }
+}
+
+/**
+ * Unregister a socket, call before closing it
+ * @param fd Socket descriptor
+ */
+void reactor_del(int fd) {
+    reactor_watch_t *w = find_watch(fd);
+    if (w) {
+        // Keep the table dense; a moved watch keeps its epoch
+        *w = g_watches[--g_nwatches];
+        g_watches[g_nwatches].fd = -1;
+    }
+}
+
+/**
+ * Arm a one-shot timer, re-arming a running timer restarts it
+ * @param timer Caller owned timer
+ * @param ms Delay, rounded up to REACTOR_TICK_MS
+ * @param cb Called on expiry
+ * @param arg Passed to cb
+ */
+void reactor_timer_start(reactor_timer_t *timer, uint32_t ms, reactor_timer_cb_t cb, void *arg) {
+    uint32_t ticks = (ms + REACTOR_TICK_MS - 1) / REACTOR_TICK_MS;
+
+    reactor_timer_stop(timer);
+    if (0 == g_ntimers) {
+        g_wheel_ms = plat_now_ms();  // Idle wheel: restart the clock
+    }
+    if (0 == ticks) {
+        ticks = 1;
+    }
+
+    timer->cb = cb;
+    timer->arg = arg;
+    timer->rounds = (ticks - 1) / REACTOR_WHEEL_SLOTS;
+    timer->slot = (g_wheel_pos + ticks) & (REACTOR_WHEEL_SLOTS - 1);
+    timer->next = g_wheel[timer->slot];
+    timer->armed = 1;
+    g_wheel[timer->slot] = timer;
+    g_ntimers++;
+}
+
+/**
+ * Find the link that points at a timer in a timer list
+ * @return Link to the timer, or the terminating NULL link if it is not there
+ */
+static reactor_timer_t **find_timer_link(reactor_timer_t **pp, reactor_timer_t *timer) {
+    while (*pp && *pp != timer) {
+        pp = &(*pp)->next;
+    }
+    return pp;
+}
+
+/**
+ * Disarm a timer, harmless if it is not armed
+ * @param timer Timer to disarm
+ */
+void reactor_timer_stop(reactor_timer_t *timer) {
+    reactor_timer_t **pp;
+
+    if (!timer->armed) {
+        return;
+    }
+    pp = find_timer_link(&g_wheel[timer->slot], timer);
+    if (NULL == *pp) {  // Stopped from a callback while its slot is being run
+        pp = find_timer_link(&g_expiring, timer);
+    }
+    if (*pp) {
+        *pp = timer->next;
+    }
+    timer->armed = 0;
+    timer->next = NULL;
+    g_ntimers--;
+}
+
+/**
+ * Advance the timer wheel to the current tick and run expired timers
+ * Each slot is detached before it runs, so a callback that re-arms its
+ * timer, even for a whole number of wheel turns, lands back in the wheel
+ * and waits for a later tick.
+ * @return Number of timer callbacks run
+ */
+static int advance_wheel() {
+    uint32_t now = plat_now_ms();
+    uint32_t elapsed = (now - g_wheel_ms) / REACTOR_TICK_MS;
+    int fired = 0;
+
+    if (0 == g_ntimers) {
+        g_wheel_ms = now;
+        return 0;
+    }
+    g_wheel_ms += elapsed * REACTOR_TICK_MS;
+
+    while (elapsed-- > 0) {
+        g_wheel_pos = (g_wheel_pos + 1) & (REACTOR_WHEEL_SLOTS - 1);
+        g_expiring = g_wheel[g_wheel_pos];
+        g_wheel[g_wheel_pos] = NULL;
+        while (g_expiring) {
+            reactor_timer_t *t = g_expiring;
+            g_expiring = t->next;
+            if (t->rounds > 0) {
+                t->rounds--;
+                t->next = g_wheel[g_wheel_pos];
+                g_wheel[g_wheel_pos] = t;
+                continue;
+            }
+            t->next = NULL;     // Unlinked before the callback, it may re-arm
+            t->armed = 0;
+            g_ntimers--;
+            t->cb(t->arg);
+            fired++;
+        }
+    }
+    return fired;
+}
+
+/**
+ * Milliseconds until the wheel next needs advancing, capped by max_ms
+ */
+static uint32_t next_timeout_ms(uint32_t max_ms) {
+    if (0 == g_ntimers) {
+        return max_ms;
+    }
+    uint32_t spent = plat_now_ms() - g_wheel_ms;
+    uint32_t wait = spent < REACTOR_TICK_MS ? REACTOR_TICK_MS - spent : 0;
+    return wait < max_ms ? wait : max_ms;
+}
+
+/**
+ * Account one iteration's busy time
+ * @param busy_us Time spent dispatching, select wait excluded
+ */
+static void record_iteration(uint32_t busy_us) {
+    int bucket = 0;
+    while (busy_us >> (bucket + 1) && bucket < REACTOR_HIST_BUCKETS - 1) {
+        bucket++;
+    }
+    g_stats.hist[bucket]++;
+    g_stats.iterations++;
+    if (busy_us > g_stats.max_busy_us) {
+        g_stats.max_busy_us = busy_us;
+    }
+}
+
+/**
+ * Run one reactor iteration: wait for socket readiness or the next timer
+ * tick, then dispatch ready sockets and expired timers
+ * @param max_wait_ms Longest time to block in select()
+ * @return Number of callbacks run, -1 if select() failed
+ */
+int reactor_run_once(uint32_t max_wait_ms) {
+    fd_set rfds, wfds;
+    int maxfd = -1;
+    int dispatched = 0;
+    uint32_t wait_ms = next_timeout_ms(max_wait_ms);
+    struct timeval tv = { wait_ms / 1000, (wait_ms % 1000) * 1000 };
+
+    FD_ZERO(&rfds);
+    FD_ZERO(&wfds);
+    for (int i = 0; i < g_nwatches; i++) {
+        reactor_watch_t *w = &g_watches[i];
+        if (w->events & REACTOR_READ) {
+            FD_SET(w->fd, &rfds);
+        }
+        if (w->events & REACTOR_WRITE) {
+            FD_SET(w->fd, &wfds);
+        }
+        if (w->events && w->fd > maxfd) {
+            maxfd = w->fd;
+        }
+    }
+
+    int ready = 0;
+    if (maxfd >= 0) {
+        ready = select(maxfd + 1, &rfds, &wfds, NULL, &tv);
+        if (ready < 0) {
+            ESP_LOGE(TAG, "select failed: errno %d", errno);
+            return -1;
+        }
+    } else if (wait_ms > 0) {
+        plat_sleep_ms(wait_ms);
+    }
+
+    int64_t start_us = plat_now_us();
+    uint32_t epoch = g_epoch++;
+
+    // Callbacks may add or delete watches, so re-check each slot as we go
+    for (int i = 0; ready > 0 && i < g_nwatches; i++) {
+        reactor_watch_t *w = &g_watches[i];
+        int fd = w->fd;
+        int events = 0;
+
+        if (w->epoch > epoch || (!FD_ISSET(fd, &rfds) && !FD_ISSET(fd, &wfds))) {
+            continue;
+        }
+        if (FD_ISSET(fd, &rfds)) {
+            events |= REACTOR_READ;
+        }
+        if (FD_ISSET(fd, &wfds)) {
+            events |= REACTOR_WRITE;
+        }
+        FD_CLR(fd, &rfds);          // A watch moved into this slot must not run twice
+        FD_CLR(fd, &wfds);
+        ready--;
+
+        w->cb(fd, events, w->arg);
+        dispatched++;
+        if (i < g_nwatches && g_watches[i].fd != fd) {
+            i--;                    // Slot was refilled by reactor_del(), visit it again
+        }
+    }
+
+    dispatched += advance_wheel();
+
+    g_stats.dispatched += dispatched;
+    record_iteration((uint32_t)(plat_now_us() - start_us));
+    return dispatched;
+}
+
+/**
+ * Get reactor statistics since boot
+ * @param stats Output statistics
+ */
+void reactor_get_stats(reactor_stats_t *stats) {
+    memcpy(stats, &g_stats, sizeof(reactor_stats_t));
+}
+
+/**
+ * Log reactor statistics
+ */
+void reactor_dump_stats() {
+    ESP_LOGI(TAG, "iterations %u, callbacks %u, max busy %u us",
+             g_stats.iterations, g_stats.dispatched, g_stats.max_busy_us);
+    for (int i = 0; i < REACTOR_HIST_BUCKETS; i++) {
+        if (g_stats.hist[i]) {
+            ESP_LOGI(TAG, "  busy < %6u us: %u", 2u << i, g_stats.hist[i]);
+        }
+    }
+}
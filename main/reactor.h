@@ -0,0 +1,76 @@
+/********************************************************************\
+ * This program is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as   *
+ * published by the Free Software Foundation; either version 2 of   *
+ * the License, or (at your option) any later version.              *
+ *                                                                  *
+ * This program is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of   *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the    *
+ * GNU General Public License for more details.                     *
+ *                                                                  *
+ * You should have received a copy of the GNU General Public License*
+ * along with this program; if not, contact:                        *
+ *                                                                  *
+ * Free Software Foundation           Voice:  +1-617-542-5942       *
+ * 59 Temple Place - Suite 330        Fax:    +1-617-542-2652       *
+ * Boston, MA  02111-1307,  USA       gnu@gnu.org                   *
+ *                                                                  *
+\********************************************************************/
+
+/** @file reactor.h
+    @author Copyright (C) 2025 LYC <365256281@qq.com>
+*/
+
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <stdint.h>
+
+// Single task event loop: lwip select() over registered sockets plus a
+// timer wheel. Callbacks run on the task that calls reactor_run_once().
+
+#define REACTOR_MAX_FDS			12		// main socket + local sockets + spare
+#define REACTOR_WHEEL_SLOTS		64		// must be a power of two
+#define REACTOR_TICK_MS			50		// timer wheel resolution
+#define REACTOR_HIST_BUCKETS	16		// log2 buckets of iteration busy time, in us
+
+#define REACTOR_READ			0x01
+#define REACTOR_WRITE			0x02
+
+typedef void (*reactor_io_cb_t)(int fd, int events, void *arg);
+typedef void (*reactor_timer_cb_t)(void *arg);
+
+typedef struct reactor_timer {
+	struct reactor_timer	*next;
+	reactor_timer_cb_t		cb;
+	void					*arg;
+	uint32_t				rounds;		// full wheel turns left before expiry
+	uint32_t				slot;
+	int						armed;
+} reactor_timer_t;
+
+typedef struct reactor_stats {
+	uint32_t	iterations;
+	uint32_t	dispatched;		// io and timer callbacks run
+	uint32_t	max_busy_us;	// longest iteration, select wait excluded
+	uint32_t	hist[REACTOR_HIST_BUCKETS];	// hist[i]: busy time in [2^i, 2^(i+1)) us, hist[0] also < 1 us
+} reactor_stats_t;
+
+int  reactor_add(int fd, int events, reactor_io_cb_t cb, void *arg);
+
+void reactor_mod(int fd, int events);
+
+void reactor_del(int fd);
+
+void reactor_timer_start(reactor_timer_t *timer, uint32_t ms, reactor_timer_cb_t cb, void *arg);
+
+void reactor_timer_stop(reactor_timer_t *timer);
+
+int  reactor_run_once(uint32_t max_wait_ms);
+
+void reactor_get_stats(reactor_stats_t *stats);
+
+void reactor_dump_stats();
+
+#endif //REACTOR_H
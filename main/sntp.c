@@ -26,52 +26,504 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <sys/time.h>
 #include "sntp.h"
 #include "control.h"
+#include "login.h"
+#include "reactor.h"
+#include "config.h"
 
 static const char *TAG = "sntp_time";
 
+#define NTP_PACKET_SIZE		48
+#define NTP_UNIX_DELTA		2208988800u		// 1900-01-01 to 1970-01-01 in seconds
+#define CLOCK_MAGIC			0x434c4b31u		// "CLK1"
+#define CLOCK_NVS_NS		"clock"
+#define CLOCK_NVS_KEY		"last"
+
+// Last known time, kept in RTC memory across resets and in NVS across power loss
+typedef struct clock_record {
+	uint32_t	magic;
+	uint32_t	wall;		// Unix seconds when saved
+	int32_t		drift_ppm;
+	uint32_t	check;		// magic ^ wall ^ drift_ppm, rejects RTC memory garbage
+} clock_record_t;
+
+static clock_source_t g_source = CLOCK_NONE;
+static int64_t  g_base_us = 0;          // plat_now_us() when the offset was taken
+static int64_t  g_base_wall_us = 0;     // wall time at g_base_us
+static int32_t  g_drift_ppm = 0;
+static int64_t  g_sntp_mono_us = 0;     // previous SNTP sample, for the drift estimate
+static int64_t  g_sntp_wall_us = 0;
+static clock_stats_t g_stats;
+
+static int      g_sntp_sock = -1;
+static struct sockaddr_in g_servers[SNTP_MAX_SERVERS];
+static int      g_nservers = 0;
+static uint32_t g_nonce = 0;            // transmit timestamp of the round in flight, 0 if none
+static int64_t  g_sent_us = 0;
+static reactor_timer_t g_sntp_timer;
+static reactor_timer_t g_save_timer;
+
+static struct sockaddr_in g_http_addr;   // Date probe target, resolved once by init_sntp()
+static int      g_http_sock = -1;       // Date probe in flight, -1 if none
+static int      g_http_sent = 0;        // request written, now reading
+static char     g_http_buf[HTTP_TIME_RESP_MAX + 1];
+static uint     g_http_len = 0;
+static int64_t  g_http_sent_us = 0;
+static reactor_timer_t g_http_timer;
+
+static void http_probe(void *arg);
+
+/**
+ * Wall time in microseconds, drift corrected
+ */
+static int64_t wall_now_us(void) {
+    int64_t elapsed = plat_now_us() - g_base_us;
+    return g_base_wall_us + elapsed + elapsed / 1000000 * g_drift_ppm;
+}
+
+/**
+ * Rebase the wall clock on a new reference
+ * @param wall_us Wall time now, in microseconds
+ * @param source Where it came from
+ */
+static void clock_set(int64_t wall_us, clock_source_t source) {
+    if (source > CLOCK_PERSISTED && g_source != CLOCK_NONE) {
+        g_stats.last_step_ms = (int32_t)((wall_us - wall_now_us()) / 1000);
+    }
+    g_base_us = plat_now_us();
+    g_base_wall_us = wall_us;
+    g_source = source;
+    g_stats.source = source;
+}
+
+static uint32_t record_check(const clock_record_t *r) {
+    return r->magic ^ r->wall ^ (uint32_t)r->drift_ppm;
+}
+
+/**
+ * Persist the current time to RTC memory, and to NVS when asked
+ * @param to_nvs Also write flash, only on SNTP syncs to spare it
+ */
+static void clock_save(int to_nvs) {
+    clock_record_t r;
+
+    if (g_source <= CLOCK_PERSISTED) {
+        return;     // Never launder a restored time back into storage
+    }
+    r.magic = CLOCK_MAGIC;
+    r.wall = (uint32_t)(wall_now_us() / 1000000);
+    r.drift_ppm = g_drift_ppm;
+    r.check = record_check(&r);
+    plat_rtc_store(PLAT_RTC_CLOCK, &r, sizeof(r));
+    if (to_nvs) {
+        plat_nvs_set_blob(CLOCK_NVS_NS, CLOCK_NVS_KEY, &r, sizeof(r));
+    }
+}
+
+/**
+ * Restore the last known time, RTC memory first
+ * frps only checks the MD5 of token and timestamp, not its freshness, so a
+ * stale time is good enough to log in with while SNTP is still out.
+ */
+static void clock_restore(void) {
+    clock_record_t r;
+    size_t len = sizeof(r);
+    const char *from = "rtc";
+
+    if (_SUCCESS != plat_rtc_load(PLAT_RTC_CLOCK, &r, sizeof(r)) || CLOCK_MAGIC != r.magic || record_check(&r) != r.check) {
+        from = "nvs";
+        if (_SUCCESS != plat_nvs_get_blob(CLOCK_NVS_NS, CLOCK_NVS_KEY, &r, &len) || len != sizeof(r) ||
+            CLOCK_MAGIC != r.magic || record_check(&r) != r.check) {
+            return;
+        }
+    }
+    if (r.wall < CLOCK_VALID_EPOCH) {
+        return;
+    }
+    g_drift_ppm = r.drift_ppm;
+    clock_set((int64_t)r.wall * 1000000, CLOCK_PERSISTED);
+    ESP_LOGI(TAG, "time %u restored from %s, drift %d ppm", r.wall, from, r.drift_ppm);
+}
+
+/**
+ * Periodic RTC memory refresh
+ * @param arg Unused
+ */
+static void on_save_timer(void *arg) {
+    clock_save(0);
+    reactor_timer_start(&g_save_timer, CLOCK_SAVE_MS, on_save_timer, NULL);
+}
+
+/**
+ * Send a request to every server; the first valid reply wins the round
+ * @param arg Unused
+ */
+static void sntp_query(void *arg) {
+    uint8_t pkt[NTP_PACKET_SIZE];
+
+    memset(pkt, 0, sizeof(pkt));
+    pkt[0] = (4 << 3) | 3;             // LI 0, version 4, mode 3 (client)
+    g_nonce = plat_random() | 1;       // Echoed back as the originate timestamp
+    memcpy(pkt + 44, &g_nonce, sizeof(g_nonce));
+    g_sent_us = plat_now_us();
+
+    for (int i = 0; i < g_nservers; i++) {
+        sendto(g_sntp_sock, pkt, sizeof(pkt), 0, (struct sockaddr *)&g_servers[i], sizeof(g_servers[i]));
+    }
+    // Once frps's clock is in, keep trying at the resync pace in case NTP opens up
+    reactor_timer_start(&g_sntp_timer, g_source >= CLOCK_HTTP ? SNTP_RESYNC_MS : SNTP_RETRY_MS,
+                        sntp_query, NULL);
+}
+
+/**
+ * Take a valid SNTP sample
+ * @param wall_us Server time adjusted by half the round trip
+ */
+static void sntp_sample(int64_t wall_us) {
+    int64_t mono = plat_now_us();
+
+    if (g_sntp_mono_us && mono - g_sntp_mono_us >= (int64_t)CLOCK_DRIFT_MIN_MS * 1000) {
+        int64_t span = mono - g_sntp_mono_us;
+        g_drift_ppm = (int32_t)(((wall_us - g_sntp_wall_us) - span) * 1000000 / span);
+    }
+    g_sntp_mono_us = mono;
+    g_sntp_wall_us = wall_us;
+    clock_set(wall_us, CLOCK_SNTP);
+    g_stats.drift_ppm = g_drift_ppm;
+    g_stats.replies++;
+    if (0 == g_stats.synced_ms) {
+        g_stats.synced_ms = plat_now_ms() | 1;  // Never 0, that means not yet
+    }
+
+#ifdef ESP_PLATFORM
+    struct timeval tv = { (time_t)(wall_us / 1000000), (suseconds_t)(wall_us % 1000000) };
+    settimeofday(&tv, NULL);        // Keep the C library clock in step
+#endif
+    clock_save(1);
+    ESP_LOGI(TAG, "The current time: %ld (step %d ms, drift %d ppm)",
+             (long)(wall_us / 1000000), g_stats.last_step_ms, g_drift_ppm);
+}
+
 /**
- * Initialize the SNTP (Simple Network Time Protocol) client.
- * Configures the SNTP operating mode to polling and sets the NTP server.
+ * Reactor callback for the SNTP socket
+ * @param fd SNTP socket
+ * @param events Ready events
+ * @param arg Unused
+ */
+static void on_sntp_reply(int fd, int events, void *arg) {
+    uint8_t pkt[NTP_PACKET_SIZE];
+    uint32_t nonce, secs, frac;
+
+    while (recv(fd, pkt, sizeof(pkt), 0) >= NTP_PACKET_SIZE) {
+        memcpy(&nonce, pkt + 28, sizeof(nonce));     // Originate timestamp fraction
+        memcpy(&secs, pkt + 40, sizeof(secs));
+        memcpy(&frac, pkt + 44, sizeof(frac));
+        secs = ntohl(secs);
+        frac = ntohl(frac);
+
+        // Server mode, synchronized, answering this round and not a late loser
+        if ((pkt[0] & 0x07) != 4 || (pkt[0] >> 6) == 3 || 0 == pkt[1] || pkt[1] > 15 ||
+            0 == g_nonce || nonce != g_nonce || secs < NTP_UNIX_DELTA + CLOCK_VALID_EPOCH) {
+            continue;
+        }
+        g_nonce = 0;
+
+        int64_t rtt = plat_now_us() - g_sent_us;
+        sntp_sample((int64_t)(secs - NTP_UNIX_DELTA) * 1000000 + (((uint64_t)frac * 1000000) >> 32) + rtt / 2);
+        reactor_timer_start(&g_sntp_timer, SNTP_RESYNC_MS, sntp_query, NULL);
+    }
+}
+
+/**
+ * Resolve the configured SNTP servers
+ */
+static void sntp_resolve(void) {
+    char list[] = CONFIG_FRPC_SNTP_SERVERS;
+    char *save = NULL;
+
+    for (char *name = strtok_r(list, ", ", &save); name && g_nservers < SNTP_MAX_SERVERS;
+         name = strtok_r(NULL, ", ", &save)) {
+        struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_DGRAM };
+        struct addrinfo *res = NULL;
+
+        if (0 != getaddrinfo(name, "123", &hints, &res) || NULL == res) {
+            ESP_LOGW(TAG, "cannot resolve %s", name);
+            continue;
+        }
+        memcpy(&g_servers[g_nservers++], res->ai_addr, sizeof(struct sockaddr_in));
+        freeaddrinfo(res);
+    }
+}
+
+/**
+ * Resolve the HTTP Date probe target
+ * Runs once from init_sntp(), before the reactor, so no probe ever waits on DNS.
+ * @return _SUCCESS, or _FAIL if the host does not resolve
+ */
+static int http_resolve(void) {
+    const char *host = CONFIG_FRPC_TIME_HTTP_HOST[0] ? CONFIG_FRPC_TIME_HTTP_HOST : g_device_config.frp_server;
+    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *res = NULL;
+
+    if (0 != getaddrinfo(host, NULL, &hints, &res) || NULL == res) {
+        ESP_LOGW(TAG, "cannot resolve %s, no HTTP time probe", host);
+        return _FAIL;
+    }
+    memcpy(&g_http_addr, res->ai_addr, sizeof(g_http_addr));
+    g_http_addr.sin_port = htons(CONFIG_FRPC_TIME_HTTP_PORT);
+    freeaddrinfo(res);
+    return _SUCCESS;
+}
+
+/**
+ * Days from 1970-01-01 to a civil date, proleptic Gregorian
+ */
+static int64_t days_from_civil(int y, int m, int d) {
+    y -= m <= 2;
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return (int64_t)era * 146097 + doe - 719468;
+}
+
+/**
+ * Parse an RFC 1123 HTTP date, "Sun, 06 Nov 1994 08:49:37 GMT"
+ * @param value Header value
+ * @param secs Output Unix seconds
+ * @return _SUCCESS, _FAIL if malformed
+ */
+static int parse_http_date(const char *value, int64_t *secs) {
+    static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    char mon[4];
+    int d, y, hh, mm, ss;
+
+    if (6 != sscanf(value, "%*3s, %d %3s %d %d:%d:%d GMT", &d, mon, &y, &hh, &mm, &ss)) {
+        return _FAIL;
+    }
+    const char *p = strstr(months, mon);
+    if (NULL == p || (p - months) % 3) {
+        return _FAIL;
+    }
+    *secs = days_from_civil(y, (p - months) / 3 + 1, d) * 86400 + hh * 3600 + mm * 60 + ss;
+    return _SUCCESS;
+}
+
+/**
+ * Finish a Date probe and schedule the next one
+ * @param next_ms Delay until the next probe
+ */
+static void http_done(uint32_t next_ms) {
+    if (g_http_sock >= 0) {
+        reactor_del(g_http_sock);
+        close(g_http_sock);
+        g_http_sock = -1;
+    }
+    reactor_timer_start(&g_http_timer, next_ms, http_probe, NULL);
+}
+
+/**
+ * Look for a complete Date header in what has been received
+ * @return _SUCCESS once the clock was set, _FAIL if not there (yet)
+ */
+static int http_take_date(void) {
+    for (char *line = strstr(g_http_buf, "\r\n"); line; line = strstr(line + 2, "\r\n")) {
+        int64_t secs;
+
+        if (0 == strncasecmp(line + 2, "Date:", 5) && strstr(line + 2, "\r\n") &&
+            _SUCCESS == parse_http_date(line + 7 + strspn(line + 7, " "), &secs) && secs >= CLOCK_VALID_EPOCH) {
+            int64_t rtt = plat_now_us() - g_http_sent_us;
+
+            g_stats.http_rtt_ms = (uint32_t)(rtt / 1000);
+            g_stats.http_syncs++;
+            if (g_source > CLOCK_HTTP) {
+                return _SUCCESS;    // SNTP got there first and is finer
+            }
+            // Stamped somewhere in that second, about half a round trip ago
+            clock_set(secs * 1000000 + 500000 + rtt / 2, CLOCK_HTTP);
+            clock_save(1);
+            ESP_LOGI(TAG, "The current time: %ld from HTTP Date (step %d ms, rtt %u ms)",
+                     (long)secs, g_stats.last_step_ms, g_stats.http_rtt_ms);
+            return _SUCCESS;
+        }
+    }
+    return _FAIL;
+}
+
+/**
+ * Reactor callback for the Date probe socket
+ * @param fd Probe socket
+ * @param events Ready events
+ * @param arg Unused
+ */
+static void on_http_event(int fd, int events, void *arg) {
+    if (!g_http_sent) {
+        char req[128];
+        int err = 0;
+        socklen_t len = sizeof(err);
+
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        int n = snprintf(req, sizeof(req), "HEAD / HTTP/1.0\r\nConnection: close\r\n\r\n");
+        if (err || send(fd, req, n, 0) != n) {
+            ESP_LOGW(TAG, "HTTP time probe failed: errno %d", err ? err : errno);
+            http_done(SNTP_RETRY_MS * 5);
+            return;
+        }
+        g_http_sent = 1;
+        g_http_sent_us = plat_now_us();
+        reactor_mod(fd, REACTOR_READ);
+        return;
+    }
+
+    int n = recv(fd, g_http_buf + g_http_len, HTTP_TIME_RESP_MAX - g_http_len, 0);
+    if (n > 0) {
+        g_http_len += n;
+        g_http_buf[g_http_len] = '\0';
+        if (_SUCCESS == http_take_date()) {
+            http_done(SNTP_RESYNC_MS);
+        } else if (g_http_len == HTTP_TIME_RESP_MAX) {
+            http_done(SNTP_RETRY_MS * 5);   // Headers too long or no Date at all
+        }
+    } else if (n == 0 || (EAGAIN != errno && EWOULDBLOCK != errno)) {
+        ESP_LOGW(TAG, "HTTP time probe got no Date header");
+        http_done(SNTP_RETRY_MS * 5);
+    }
+}
+
+/**
+ * Probe timer: start a Date probe, or give up on one that hangs
+ * @param arg Unused
+ */
+static void http_probe(void *arg) {
+    if (g_http_sock >= 0) {
+        ESP_LOGW(TAG, "HTTP time probe timed out");
+        http_done(SNTP_RETRY_MS * 5);
+        return;
+    }
+    if (CLOCK_SNTP == g_source) {
+        reactor_timer_start(&g_http_timer, SNTP_RESYNC_MS, http_probe, NULL);
+        return;     // Not needed while NTP works
+    }
+
+    g_http_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (g_http_sock < 0) {
+        reactor_timer_start(&g_http_timer, SNTP_RETRY_MS * 5, http_probe, NULL);
+        return;
+    }
+    fcntl(g_http_sock, F_SETFL, fcntl(g_http_sock, F_GETFL, 0) | O_NONBLOCK);
+    if (connect(g_http_sock, (struct sockaddr *)&g_http_addr, sizeof(g_http_addr)) < 0 && EINPROGRESS != errno) {
+        http_done(SNTP_RETRY_MS * 5);
+        return;
+    }
+
+    g_http_sent = 0;
+    g_http_len = 0;
+    g_http_buf[0] = '\0';
+    reactor_add(g_http_sock, REACTOR_WRITE, on_http_event, NULL);
+    reactor_timer_start(&g_http_timer, HTTP_TIME_TIMEOUT_MS, http_probe, NULL);
+}
+
+/**
+ * Start the clock service
+ * Restores the last known time so login needs no network round trip, then
+ * queries every configured SNTP server at once and probes the frps side
+ * for an HTTP Date, all from the reactor. Never waits for an answer; host
+ * names are resolved here, before the reactor runs, and cached.
  */
 void init_sntp(void)
 {
+#ifndef ESP_PLATFORM
+    if (clock_valid()) {
+        return;     // The host OS keeps its own clock
+    }
+#endif
+    clock_restore();
+    reactor_timer_start(&g_save_timer, CLOCK_SAVE_MS, on_save_timer, NULL);
+
+    if (CONFIG_FRPC_TIME_HTTP_PORT && _SUCCESS == http_resolve()) {
+        http_probe(NULL);   // Races SNTP, for sites that block NTP
+    }
+
     ESP_LOGI(TAG, "Initializing SNTP");
-    sntp_setoperatingmode(SNTP_OPMODE_POLL);  // Set SNTP operating mode to periodic polling
-    sntp_setservername(0, "ntp.aliyun.com");  // Set primary NTP server address
-    sntp_init();  // Initialize SNTP service
+    sntp_resolve();
+    if (0 == g_nservers) {
+        return;
+    }
+    g_sntp_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (g_sntp_sock < 0) {
+        ESP_LOGE(TAG, "Unable to create SNTP socket: errno %d", errno);
+        return;
+    }
+    fcntl(g_sntp_sock, F_SETFL, fcntl(g_sntp_sock, F_GETFL, 0) | O_NONBLOCK);
+    reactor_add(g_sntp_sock, REACTOR_READ, on_sntp_reply, NULL);
+    sntp_query(NULL);
 }
 
 /**
- * Obtain the current time from the SNTP server.
- * Attempts to retrieve the current time with retries if the time is invalid.
- * 
- * @return The current Unix timestamp on success, -1 on failure.
+ * Check whether wall time is known yet
+ * A restored time counts. If nothing was restored, a system clock that
+ * already holds a plausible date (the host, or another SNTP client) is
+ * adopted. Never blocks.
+ * @return 1 once wall time is valid, 0 before
  */
-time_t obtain_time(void)
+int clock_valid(void)
 {
-    time_t now = 0;         // Stores current timestamp
-    int retry = 0;          // Retry counter
-    const int retry_count = 10;  // Maximum retry attempts
+    if (CLOCK_NONE == g_source) {
+        struct timeval tv;
 
-    // Loop until valid time is obtained or retry limit reached
-    // 1600000000 = September 13, 2020 (arbitrary valid timestamp threshold)
-    while (now < 1600000000 && ++retry < retry_count) 
-    {
-        ESP_LOGI(TAG, "Waiting for system time to be set... (%d/%d)", retry, retry_count);
-        vTaskDelay(2000 / portTICK_PERIOD_MS);  // Delay for 2 seconds (FreeRTOS)
-        time(&now);  // Update current time value
+        gettimeofday(&tv, NULL);
+        if (tv.tv_sec < CLOCK_VALID_EPOCH) {
+            return 0;
+        }
+        clock_set((int64_t)tv.tv_sec * 1000000 + tv.tv_usec, CLOCK_SYSTEM);
+        ESP_LOGI(TAG, "The current time: %ld", (long)tv.tv_sec);
     }
+    return 1;
+}
 
-    if (now < 1600000000) 
-    {
-        ESP_LOGE(TAG, "Failed to get SNTP time");
-        RESET_DEVICE;
-        return -1;  // Return error code
+/**
+ * Get the current wall time without waiting for SNTP
+ * @param now Output Unix timestamp, may be NULL to only test validity
+ * @return _SUCCESS, _FAIL while the time is not yet valid
+ */
+int clock_get_time(time_t *now)
+{
+    if (!clock_valid()) {
+        return _FAIL;
+    }
+    if (now) {
+        *now = (time_t)(wall_now_us() / 1000000);
     }
+    return _SUCCESS;
+}
+
+/**
+ * Get clock service statistics
+ * @param stats Output statistics
+ */
+void clock_get_stats(clock_stats_t *stats) {
+    memcpy(stats, &g_stats, sizeof(clock_stats_t));
+    stats->source = g_source;
+    stats->drift_ppm = g_drift_ppm;
+}
 
-    ESP_LOGI(TAG, "The current time: %ld", now);
-    
-    return now;  // Return valid Unix timestamp
+/**
+ * Printable name of a clock source
+ */
+const char *clock_source_name(clock_source_t source) {
+    switch (source) {
+    case CLOCK_PERSISTED:
+        return "persisted";
+    case CLOCK_HTTP:
+        return "http";
+    case CLOCK_SYSTEM:
+        return "system";
+    case CLOCK_SNTP:
+        return "sntp";
+    default:
+        return "none";
+    }
 }
@@ -26,13 +26,67 @@
 #define SNTP_H
 
 #include <time.h>
+#include <stdint.h>
 
-#include "esp_log.h"
-#include "lwip/apps/sntp.h"
+#include "platform.h"
 
-void init_sntp(void);
+// Wall time is served from the monotonic clock plus an offset. The offset
+// comes from the last time persisted across resets until one of several
+// SNTP servers, queried at once, answers; timeouts use plat_now_ms().
+
+#define CLOCK_VALID_EPOCH	1600000000	// 2020-09-13, anything earlier is an unset clock
+#define CLOCK_WAIT_POLL_MS	500			// login retry spacing while the time is unknown
+#define CLOCK_SAVE_MS		60000		// RTC memory refresh, bounds the time lost on reset
+#define CLOCK_DRIFT_MIN_MS	600000		// shortest SNTP to SNTP span used for a drift estimate
+
+#define SNTP_MAX_SERVERS	4
+#define SNTP_RETRY_MS		2000		// resend to every server until one answers
+#define SNTP_RESYNC_MS		3600000		// re-query once synchronized
+
+#define HTTP_TIME_TIMEOUT_MS	5000		// one Date probe, connect to headers
+#define HTTP_TIME_RESP_MAX		512			// response bytes searched for the Date header
 
-time_t obtain_time(void);
+// Comma separated, queried in parallel; the first valid reply wins. Empty disables SNTP.
+#ifndef CONFIG_FRPC_SNTP_SERVERS
+#define CONFIG_FRPC_SNTP_SERVERS	"ntp.aliyun.com,ntp.tencent.com,cn.pool.ntp.org"
+#endif
 
+// HTTP endpoint whose Date header serves as a clock where NTP is blocked.
+// An empty host means the frps server; frps's dashboard answers by default.
+// Port 0 disables it.
+#ifndef CONFIG_FRPC_TIME_HTTP_HOST
+#define CONFIG_FRPC_TIME_HTTP_HOST	""
+#endif
+#ifndef CONFIG_FRPC_TIME_HTTP_PORT
+#define CONFIG_FRPC_TIME_HTTP_PORT	7500
 #endif
 
+typedef enum clock_source {
+	CLOCK_NONE,			// wall time unknown
+	CLOCK_PERSISTED,	// restored from RTC memory or NVS, possibly stale
+	CLOCK_HTTP,			// Date header from the frps side, about 0.5 s accurate
+	CLOCK_SYSTEM,		// system clock already set (host, or another SNTP client)
+	CLOCK_SNTP,			// reply from one of our SNTP servers
+} clock_source_t;
+
+typedef struct clock_stats {
+	clock_source_t	source;
+	int32_t			drift_ppm;		// monotonic clock rate error, measured between syncs
+	int32_t			last_step_ms;	// correction applied by the last sync
+	uint32_t		synced_ms;		// boot to first SNTP reply, 0 before
+	uint32_t		replies;		// valid SNTP replies
+	uint32_t		http_syncs;		// valid Date headers
+	uint32_t		http_rtt_ms;	// last Date probe, connect to headers
+} clock_stats_t;
+
+void init_sntp(void);
+
+int  clock_valid(void);
+
+int  clock_get_time(time_t *now);
+
+void clock_get_stats(clock_stats_t *stats);
+
+const char *clock_source_name(clock_source_t source);
+
+#endif
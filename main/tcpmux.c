@@ -26,24 +26,32 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
-#include "esp_log.h"
-#include "lwip/err.h"
-#include "lwip/sockets.h"
-#include "lwip/sys.h"
-#include <lwip/netdb.h>
+#include <assert.h>
+#include "platform.h"
 #include "control.h"
+#include "login.h"
 #include "tcpmux.h"
 
 extern Control_t *g_pMainCtl;       // Main control structure
-extern char g_ProxyWork;
-extern int linked;                  // Connection status flag
-
-// 连接状态控制函数声明 (定义在timer.c中)
-extern void set_frpc_connection_lost(void);
 
 static char proto_version = 0;      // Protocol version number
 static const char *TAG = "tcpmux";
 
+/**
+ * Initialize a stream with the yamux default windows.
+ * 
+ * @param pStream Pointer to the stream structure
+ * @param uiStreamId Stream identifier
+ */
+void tmux_stream_init(tmux_stream_t *pStream, uint uiStreamId)
+{
+    memset(pStream, 0, sizeof(tmux_stream_t));
+    pStream->id = uiStreamId;
+    pStream->state = INIT;
+    pStream->recv_window = TMUX_MAX_WINDOW;
+    pStream->send_window = TMUX_MAX_WINDOW;
+}
+
 /**
  * Get the flags to be sent based on the current state of the stream.
  * This function determines the appropriate flags (e.g., SYN, ACK) to send
@@ -125,7 +133,8 @@ int send_window_update(int iSockfd, tmux_stream_t *pStream, uint uiLength)
     if(send(iSockfd, (uchar *)&tmux_hdr, sizeof(tmux_hdr), 0)<0) 
     {
         ESP_LOGE(TAG, "error: window update send FAIL");
-        RESET_DEVICE;
+        mark_session_broken();
+        return _FAIL;
     }
     
     ESP_LOGI(TAG, "send window update: flags %d, stream_id %d, length %u", flags, pStream->id, uiLength);
@@ -134,27 +143,182 @@ int send_window_update(int iSockfd, tmux_stream_t *pStream, uint uiLength)
 }
 
 /**
- * Send a TCP multiplexing header for data transmission.
- * This function constructs and sends a data header with the specified
- * flags, stream ID, and payload length.
+ * Account for received payload that has been consumed.
+ * Credit is returned to the peer in one window update once half of the
+ * window has been consumed, instead of one update per data frame.
  * 
  * @param iSockfd Socket file descriptor
- * @param flags Control flags for the data message
- * @param stream_id Stream identifier
- * @param length Length of the data payload
+ * @param pStream Pointer to the stream structure
+ * @param uiLength Number of payload bytes consumed
+ * @return Success or failure code
  */
-void tcp_mux_send_hdr(int iSockfd, ushort flags, uint stream_id, uint length)
+int tmux_stream_consumed(int iSockfd, tmux_stream_t *pStream, uint uiLength)
 {
-    struct tcp_mux_header tmux_hdr;
-    
+    uint delta;
+
+    if (uiLength > pStream->recv_window) {
+        ESP_LOGE(TAG, "error: stream %d received %u bytes beyond its window", pStream->id, uiLength - pStream->recv_window);
+        uiLength = pStream->recv_window;
+    }
+    pStream->recv_window -= uiLength;
+    pStream->recv_consumed += uiLength;
+
+    if (pStream->recv_consumed < TMUX_MAX_WINDOW / 2) {
+        return _SUCCESS;
+    }
+
+    delta = pStream->recv_consumed;
+    pStream->recv_consumed = 0;
+    pStream->recv_window += delta;
+    return send_window_update(iSockfd, pStream, delta);
+}
+
+/**
+ * Apply a window update received from the peer.
+ * 
+ * @param pStream Pointer to the stream structure
+ * @param uiDelta Additional send credit granted by the peer
+ */
+void tmux_stream_credit(tmux_stream_t *pStream, uint uiDelta)
+{
+    pStream->send_window += uiDelta;
+    ESP_LOGI(TAG, "stream %d send window %u (+%u)", pStream->id, pStream->send_window, uiDelta);
+}
+
+/**
+ * Check that a DATA frame can go out on the stream right now: the stream
+ * is open for sending and the peer's window takes the whole payload.
+ * 
+ * @param pStream Pointer to the stream structure
+ * @param uiLength Payload length
+ * @return 1 if tmux_stream_writev() would send it whole, 0 otherwise
+ */
+int tmux_stream_writable(const tmux_stream_t *pStream, uint uiLength)
+{
+    switch (pStream->state) {
+    case LOCAL_CLOSE:
+    case CLOSED:
+    case RESET:
+        return 0;
+    default:
+        return uiLength <= pStream->send_window;
+    }
+}
+
+/**
+ * Half-close a stream by sending a window update carrying the FIN flag.
+ * The stream moves to LOCAL_CLOSE, or to CLOSED when the peer has
+ * already closed its side.
+ * 
+ * @param iSockfd Socket file descriptor
+ * @param pStream Pointer to the stream structure
+ * @return Success or failure code
+ */
+int send_stream_close(int iSockfd, tmux_stream_t *pStream)
+{
+    tcp_mux_header_t tmux_hdr;
+    ushort flags;
+
+    switch (pStream->state) {
+    case LOCAL_CLOSE:
+    case CLOSED:
+    case RESET:
+        return _SUCCESS;          // Nothing left to close
+    case REMOTE_CLOSE:
+        flags = FIN;
+        pStream->state = CLOSED;
+        break;
+    default:
+        flags = get_send_flags(pStream) | FIN;
+        pStream->state = LOCAL_CLOSE;
+        break;
+    }
+
+    memset(&tmux_hdr, 0, sizeof(tmux_hdr));
+    tcp_mux_encode(WINDOW_UPDATE, flags, pStream->id, 0, &tmux_hdr);
+
+    if (send(iSockfd, (uchar *)&tmux_hdr, sizeof(tmux_hdr), 0) < 0)
+    {
+        ESP_LOGE(TAG, "error: stream close send FAIL");
+        mark_session_broken();
+        return _FAIL;
+    }
+
+    ESP_LOGI(TAG, "send stream close: flags %d, stream_id %d", flags, pStream->id);
+
+    return _SUCCESS;
+}
+
+/**
+ * Abort a stream by sending a window update carrying the RST flag.
+ * 
+ * @param iSockfd Socket file descriptor
+ * @param pStream Pointer to the stream structure
+ * @return Success or failure code
+ */
+int send_stream_reset(int iSockfd, tmux_stream_t *pStream)
+{
+    tcp_mux_header_t tmux_hdr;
+
+    if (CLOSED == pStream->state || RESET == pStream->state) {
+        return _SUCCESS;
+    }
+    pStream->state = RESET;
+
     memset(&tmux_hdr, 0, sizeof(tmux_hdr));
-    tcp_mux_encode(DATA, flags, stream_id, length, &tmux_hdr);
-    if(send(iSockfd, (char *)&tmux_hdr, sizeof(tmux_hdr), 0)<0) 
+    tcp_mux_encode(WINDOW_UPDATE, RST, pStream->id, 0, &tmux_hdr);
+
+    if (send(iSockfd, (uchar *)&tmux_hdr, sizeof(tmux_hdr), 0) < 0)
     {
-        ESP_LOGE(TAG, "error: tcp mux hdr send_FAIL");
-        RESET_DEVICE;
+        ESP_LOGE(TAG, "error: stream reset send FAIL");
+        mark_session_broken();
+        return _FAIL;
     }
-    ESP_LOGI(TAG, "tcp mux header,stream_id:%d len:%d", stream_id, length);
+
+    ESP_LOGI(TAG, "send stream reset: stream_id %d", pStream->id);
+
+    return _SUCCESS;
+}
+
+/**
+ * Send a gather list on the socket with as few syscalls as possible.
+ * The tcp mux header and its payload go out in one sendmsg() so they
+ * share a TCP segment; short sends are resumed until everything is out.
+ * 
+ * @param iSockfd Socket file descriptor
+ * @param iov Gather list, modified in place while sending
+ * @param iovcnt Number of entries in the gather list
+ * @return Success or failure code
+ */
+int tcp_mux_sendv(int iSockfd, struct iovec *iov, int iovcnt)
+{
+    struct msghdr msg;
+    int sent;
+
+    while (iovcnt > 0) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt;
+
+        sent = sendmsg(iSockfd, &msg, 0);
+        if (sent < 0) {
+            ESP_LOGE(TAG, "error: tcp mux sendmsg FAIL, errno %d", errno);
+            return _FAIL;
+        }
+
+        // Skip fully sent entries and trim the partially sent one
+        while (iovcnt > 0 && (size_t)sent >= iov->iov_len) {
+            sent -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + sent;
+            iov->iov_len -= sent;
+        }
+    }
+
+    return _SUCCESS;
 }
 
 /**
@@ -174,10 +338,6 @@ int process_flags(uint16_t flags, struct tmux_stream *stream)
         if (SYN_SEND == stream->state) stream->state = ESTABLISHED;
     } else if (FIN == (flags & FIN)) {
         // Handle FIN flag (connection termination)
-        g_ProxyWork = 0;
-        linked = 0;
-        set_frpc_connection_lost();  // 正常断开时设置LED闪烁
-        
         switch(stream->state) {
         case SYN_SEND:
         case SYN_RECEIVED:
@@ -211,13 +371,11 @@ int process_flags(uint16_t flags, struct tmux_stream *stream)
  * This function processes ping requests and sends back appropriate responses
  * when a SYN flag is detected in the ping message.
  * 
- * @param pTmux_hdr Pointer to the TCP multiplexing header of the ping message
+ * @param flags Flags of the ping frame (host byte order)
+ * @param ping_id Opaque ping identifier carried in the length field
  */
-void handle_tcp_mux_ping(struct tcp_mux_header *pTmux_hdr)
+void handle_tcp_mux_ping(ushort flags, uint ping_id)
 {    
-    uint16_t flags = ntohs(pTmux_hdr->flags);
-    uint32_t ping_id = ntohl(pTmux_hdr->length);
-
     if (SYN == (flags & SYN)) 
     {        
         struct tcp_mux_header Tmux_hdr_send = {0};
@@ -230,8 +388,208 @@ void handle_tcp_mux_ping(struct tcp_mux_header *pTmux_hdr)
         if (send(g_pMainCtl->iMainSock, &Tmux_hdr_send, sizeof(Tmux_hdr_send), 0) < 0)
         {
             ESP_LOGI(TAG, "error: handle tcp mux ping send FAIL");
-            RESET_DEVICE;
+            mark_session_broken();
             return;
         }        
     }
 }
+
+/**
+ * Send a session level ping; frps answers with an ACK carrying the same id.
+ * 
+ * @param iSockfd Socket file descriptor
+ * @param uiPingId Opaque ping identifier
+ * @return Success or failure code
+ */
+int send_ping(int iSockfd, uint uiPingId)
+{
+    tcp_mux_header_t tmux_hdr;
+
+    tcp_mux_encode(PING, SYN, 0, uiPingId, &tmux_hdr);
+
+    if (send(iSockfd, (uchar *)&tmux_hdr, sizeof(tmux_hdr), 0) < 0)
+    {
+        ESP_LOGE(TAG, "error: ping send FAIL");
+        mark_session_broken();
+        return _FAIL;
+    }
+
+    ESP_LOGI(TAG, "send ping %u", uiPingId);
+
+    return _SUCCESS;
+}
+
+/**
+ * Reset a frame reader to an empty ring with no frame in progress.
+ * 
+ * @param pReader Pointer to the reader
+ */
+void tmux_reader_init(tmux_reader_t *pReader)
+{
+    memset(pReader, 0, sizeof(tmux_reader_t));
+}
+
+/**
+ * Copy bytes out of the ring, handling wrap-around.
+ * 
+ * @param pReader Pointer to the reader
+ * @param dst Destination buffer
+ * @param length Number of bytes to consume, must not exceed pReader->count
+ */
+static void tmux_reader_take(tmux_reader_t *pReader, uchar *dst, uint length)
+{
+    uint first = TMUX_RING_SIZE - pReader->head;
+
+    if (first > length) {
+        first = length;
+    }
+    memcpy(dst, pReader->ring + pReader->head, first);
+    memcpy(dst + first, pReader->ring, length - first);
+
+    pReader->head = (pReader->head + length) & (TMUX_RING_SIZE - 1);
+    pReader->count -= length;
+}
+
+/**
+ * Receive whatever the socket has into the free part of the ring.
+ * A single recv() is issued, so a short read is never an error.
+ * 
+ * @param pReader Pointer to the reader
+ * @param iSockfd Socket file descriptor
+ * @return Bytes received, 0 when the peer closed, negative on socket error
+ */
+int tmux_reader_fill(tmux_reader_t *pReader, int iSockfd)
+{
+    uint tail = (pReader->head + pReader->count) & (TMUX_RING_SIZE - 1);
+    uint space = TMUX_RING_SIZE - pReader->count;
+    int rx_len;
+
+    if (0 == space) {
+        ESP_LOGE(TAG, "error: tmux reader ring full");
+        return -1;
+    }
+    if (space > TMUX_RING_SIZE - tail) {
+        space = TMUX_RING_SIZE - tail;   // Contiguous part only, the rest on the next call
+    }
+
+    rx_len = recv(iSockfd, pReader->ring + tail, space, 0);
+    if (rx_len > 0) {
+        pReader->count += rx_len;
+    }
+    return rx_len;
+}
+
+/**
+ * Append bytes already received elsewhere to the ring.
+ * 
+ * @param pReader Pointer to the reader
+ * @param data Bytes to append
+ * @param length Number of bytes
+ * @return Number of bytes accepted (less than length when the ring is full)
+ */
+uint tmux_reader_push(tmux_reader_t *pReader, const uchar *data, uint length)
+{
+    uint tail = (pReader->head + pReader->count) & (TMUX_RING_SIZE - 1);
+    uint first;
+
+    if (length > TMUX_RING_SIZE - pReader->count) {
+        length = TMUX_RING_SIZE - pReader->count;
+    }
+    first = TMUX_RING_SIZE - tail;
+    if (first > length) {
+        first = length;
+    }
+    memcpy(pReader->ring + tail, data, first);
+    memcpy(pReader->ring, data + first, length - first);
+    pReader->count += length;
+
+    return length;
+}
+
+/**
+ * Parse the header of the next frame without taking its payload, so the
+ * caller can size the buffer it passes to tmux_reader_next() by stream.
+ * 
+ * @param pReader Pointer to the reader
+ * @return The frame being delivered (offset says how much of it already
+ *         was), NULL until a whole header is buffered
+ */
+const tmux_frame_t *tmux_reader_peek(tmux_reader_t *pReader)
+{
+    tmux_frame_t *cur = &pReader->cur;
+
+    if (!pReader->in_frame) {
+        tcp_mux_header_t tmux_hdr;
+
+        if (pReader->count < sizeof(tmux_hdr)) {
+            return NULL;
+        }
+        tmux_reader_take(pReader, (uchar *)&tmux_hdr, sizeof(tmux_hdr));
+
+        memset(cur, 0, sizeof(tmux_frame_t));
+        cur->type = tmux_hdr.type;
+        cur->flags = ntohs(tmux_hdr.flags);
+        cur->stream_id = ntohl(tmux_hdr.stream_id);
+        cur->length = ntohl(tmux_hdr.length);
+        pReader->in_frame = 1;
+    }
+    return cur;
+}
+
+/**
+ * Extract the next frame from the ring.
+ * Frames whose payload fits in buf are delivered whole once fully buffered.
+ * Larger payloads are streamed out in chunks of at most size bytes as they
+ * arrive, with offset and last describing the position in the frame.
+ * Frames without payload (WINDOW_UPDATE, PING, GO_AWAY) have len 0.
+ * 
+ * @param pReader Pointer to the reader
+ * @param pFrame Output frame description
+ * @param buf Payload output buffer
+ * @param size Size of the payload buffer, must not exceed TMUX_RING_SIZE;
+ *             0 holds back the payload of the current frame
+ * @return 1 if a frame or chunk was produced, 0 if more bytes are needed
+ */
+int tmux_reader_next(tmux_reader_t *pReader, tmux_frame_t *pFrame, uchar *buf, uint size)
+{
+    tmux_frame_t *cur = (tmux_frame_t *)tmux_reader_peek(pReader);
+    uint remaining;
+    uint n;
+
+    if (NULL == cur) {
+        return 0;
+    }
+    if (DATA != cur->type || 0 == cur->length) {
+        cur->last = 1;
+        *pFrame = *cur;
+        pReader->in_frame = 0;
+        return 1;
+    }
+
+    remaining = cur->length - cur->offset;
+    if (cur->length <= size) {
+        if (pReader->count < remaining) {
+            return 0;                       // Wait for the whole frame
+        }
+        n = remaining;
+    } else {
+        n = remaining < size ? remaining : size;
+        if (n > pReader->count) {
+            n = pReader->count;
+        }
+        if (0 == n) {
+            return 0;
+        }
+    }
+
+    tmux_reader_take(pReader, buf, n);
+
+    *pFrame = *cur;
+    pFrame->len = n;
+    cur->offset += n;
+    pFrame->last = (cur->offset == cur->length);
+    if (pFrame->last) {
+        pReader->in_frame = 0;
+    }
+    return 1;
+}
@@ -25,6 +25,8 @@
 #ifndef TCPMUX_H
 #define TCPMUX_H
 
+#include "platform.h"
+
 #define _SUCCESS 0
 typedef unsigned char uchar;
 
@@ -64,22 +66,75 @@ typedef struct __attribute__((__packed__)) tcp_mux_header
 }tcp_mux_header_t;
 
 
+// Initial per-stream window defined by yamux, both directions start with it
+#define TMUX_MAX_WINDOW     (256 * 1024)
+
 typedef struct tmux_stream {
     uint    id;
     enum tcp_mux_state state;   
+    uint    recv_window;        // bytes the peer may still send us
+    uint    send_window;        // bytes we may still send the peer
+    uint    recv_consumed;      // consumed bytes not yet credited back to the peer
 
 }tmux_stream_t;
 
+// Receive ring size, must be a power of two and hold the largest whole frame
+#define TMUX_RING_SIZE  4096
+
+// One complete frame, or one chunk of a frame larger than the caller buffer
+typedef struct tmux_frame {
+    uchar   type;
+    ushort  flags;              // host byte order
+    uint    stream_id;          // host byte order
+    uint    length;             // payload length (DATA) or value (WINDOW_UPDATE/PING/GO_AWAY)
+    uint    offset;             // offset of this chunk in the payload
+    uint    len;                // payload bytes in this chunk
+    int     last;               // non-zero on the final chunk of the frame
+}tmux_frame_t;
+
+// Resumable tcp mux frame parser fed from the main socket
+typedef struct tmux_reader {
+    uchar   ring[TMUX_RING_SIZE];
+    uint    head;               // ring read index
+    uint    count;              // bytes buffered in the ring
+    tmux_frame_t cur;           // frame whose payload is being delivered
+    int     in_frame;           // header parsed, frame not delivered yet
+}tmux_reader_t;
+
+void tmux_stream_init(tmux_stream_t *pStream, uint uiStreamId);
+
 ushort get_send_flags(struct tmux_stream *pStream);
 
 void  tcp_mux_encode(tcp_mux_type_t type, tcp_mux_flag_t flags, uint uiStreamId, uint uiLength, tcp_mux_header_t *ptmux_hdr);
 
 int send_window_update(int iSockfd, tmux_stream_t *pStream, uint uiLength);
 
-void tcp_mux_send_hdr(int iSockfd, ushort flags, uint stream_id, uint length);
+int send_stream_close(int iSockfd, tmux_stream_t *pStream);
+
+int send_stream_reset(int iSockfd, tmux_stream_t *pStream);
+
+int tmux_stream_consumed(int iSockfd, tmux_stream_t *pStream, uint uiLength);
+
+void tmux_stream_credit(tmux_stream_t *pStream, uint uiDelta);
+
+int tmux_stream_writable(const tmux_stream_t *pStream, uint uiLength);
+
+int tcp_mux_sendv(int iSockfd, struct iovec *iov, int iovcnt);
 
 int process_flags(uint16_t flags, struct tmux_stream *stream);
 
-void handle_tcp_mux_ping(struct tcp_mux_header *pTmux_hdr);
+void handle_tcp_mux_ping(ushort flags, uint ping_id);
+
+int send_ping(int iSockfd, uint uiPingId);
+
+void tmux_reader_init(tmux_reader_t *pReader);
+
+int tmux_reader_fill(tmux_reader_t *pReader, int iSockfd);
+
+uint tmux_reader_push(tmux_reader_t *pReader, const uchar *data, uint length);
+
+const tmux_frame_t *tmux_reader_peek(tmux_reader_t *pReader);
+
+int tmux_reader_next(tmux_reader_t *pReader, tmux_frame_t *pFrame, uchar *buf, uint size);
 
 #endif
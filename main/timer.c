@@ -35,13 +35,11 @@
 #include "esp_log.h"
 
 TimerHandle_t FrpcTimer;             // Handle for the FRPC timer
-extern time_t g_Pongtime;
 extern Control_t *g_pMainCtl;        // External main control structure pointer
 static const char *TAG = "timer";
 
 // 定时器相关变量
 static volatile uint32_t tickcnt = 0;     // 滴答计数器，每0.1秒递增
-static uint32_t ping_tick_count = 0;      // Ping计数器
 static bool led_state = false;            // LED状态
 
 // 连接状态管理
@@ -60,7 +58,8 @@ static connection_state_t frpc_connection_state = CONNECTION_DISCONNECTED;
 void TimerCallback(TimerHandle_t xTimer) 
 {
     tickcnt++;  // 滴答计数器递增
-    ping_tick_count++;  // Ping计数器递增
+
+    config_key_poll();  // 长按按键切换配置模式/正常模式
 
     // NET LED控制逻辑（非webserver模式下）
     if (!config_mode) {
@@ -85,38 +84,6 @@ void TimerCallback(TimerHandle_t xTimer)
         }
     }
 
-    // Ping逻辑 - 每300个tick（30秒）执行一次
-    if (ping_tick_count >= 300) {
-        ping_tick_count = 0;  // 重置ping计数器
-        
-        // 检查是否有有效的控制结构和socket
-        if (g_pMainCtl && g_pMainCtl->iMainSock > 0) {
-            // 获取当前时间
-            time_t current_time = obtain_time();
-            
-            // 计算距离上次pong的时间间隔
-            int interval = current_time - g_Pongtime;
-            
-            // 检查是否超时（40秒阈值）
-            if (g_Pongtime && interval > 40) {
-                ESP_LOGI(TAG, "Time out");
-                // 超时会导致后续的RESET_DEVICE，不需要LED闪烁
-                return;
-            }
-            
-            // 发送周期性ping到FRPS服务器
-            ESP_LOGI(TAG, "ping frps");
-            char *ping_msg = "{}";
-            send_enc_msg_frp_server(
-                g_pMainCtl->iMainSock,      // Main socket descriptor
-                TypePing,                   // Message type: PING
-                ping_msg,                   // Empty JSON payload
-                strlen(ping_msg),           // Message length
-                &g_pMainCtl->stream        // Stream context
-            );
-        }
-    }
-
     // 滴答计数器清零 - 防止溢出
     if (tickcnt == 1000) {
         tickcnt = 0;
@@ -125,7 +92,8 @@ void TimerCallback(TimerHandle_t xTimer)
 
 /**
  * Function to create and start the timer
- * Initializes and starts the timer with 0.1 second period for LED control and periodic pings.
+ * Initializes and starts the timer with 0.1 second period for LED control.
+ * Heartbeats are sent by the control session itself, see heartbeat.c.
  */
 void CreateTimer() 
 {
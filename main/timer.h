@@ -25,6 +25,9 @@
 #ifndef TIMER_H
 #define TIMER_H
 
+#include <stdint.h>
+
+#ifdef ESP_PLATFORM
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/timers.h"
@@ -32,6 +35,7 @@
 void TimerCallback(TimerHandle_t      xTimer);
 
 void CreateTimer();
+#endif
 
 // LED status control functions
 void set_frpc_connection_connected(void);
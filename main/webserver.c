@@ -1,3 +1,4 @@
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include "freertos/FreeRTOS.h"
@@ -5,30 +6,106 @@
 #include "esp_system.h"
 #include "esp_log.h"
 #include "esp_http_server.h"
+#include "esp_partition.h"
 #include "webserver.h"
 #include "config.h"
+#include "memplan.h"
 
-// 全局html数组声明
-extern uint8_t g_web_html[8192];
-extern size_t g_web_html_size;
+// web UI分区（partitions.csv），内容由tools/gen_webui.py生成：头部 + gzip后的页面
+#define WEBUI_PARTITION_LABEL   "webui"
+#define WEBUI_PARTITION_SUBTYPE 0x40
+#define WEBUI_MAGIC             0x31495557  // "WUI1"
+
+typedef struct webui_header {
+    uint32_t magic;
+    uint32_t size;      // gzip数据长度
+    uint32_t etag;      // gzip数据的CRC32
+    uint32_t check;     // magic ^ size ^ etag
+} webui_header_t;
 
 static const char *TAG = "WEBSERVER";
 
 static httpd_handle_t server = NULL;
 
-// HTTP GET处理函数 - 返回配置页面
+/**
+ * @brief 查找web UI分区并校验头部
+ *
+ * @param hdr 输出，分区头部
+ * @return 分区，未烧录或头部无效时返回NULL
+ */
+static const esp_partition_t *find_webui(webui_header_t *hdr)
+{
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                           WEBUI_PARTITION_SUBTYPE,
+                                                           WEBUI_PARTITION_LABEL);
+    if (!part) {
+        ESP_LOGE(TAG, "No %s partition", WEBUI_PARTITION_LABEL);
+        return NULL;
+    }
+    if (esp_partition_read(part, 0, hdr, sizeof(*hdr)) != ESP_OK ||
+        hdr->magic != WEBUI_MAGIC ||
+        (hdr->magic ^ hdr->size ^ hdr->etag) != hdr->check ||
+        hdr->size > part->size - sizeof(*hdr)) {
+        ESP_LOGE(TAG, "%s partition is empty or corrupt, flash it with make webui-flash",
+                 WEBUI_PARTITION_LABEL);
+        return NULL;
+    }
+    return part;
+}
+
+// HTTP GET处理函数 - 从flash分块发送gzip压缩的配置页面
 static esp_err_t get_config_page(httpd_req_t *req)
 {
+    webui_header_t hdr;
+    char etag[12];
+    char inm[sizeof(etag)];
+
     ESP_LOGI(TAG, "GET / - Serving configuration page");
-    
-    // 设置响应头
+
+    const esp_partition_t *part = find_webui(&hdr);
+    if (!part) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    // 页面未变时浏览器用缓存，只回304
+    snprintf(etag, sizeof(etag), "\"%08x\"", hdr.etag);
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", inm, sizeof(inm)) == ESP_OK &&
+        strcmp(inm, etag) == 0) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    // httpd在单个任务中依次调用处理函数，配置模式的缓冲区可以共用
+    char *chunk = mem_config()->page;
+
     httpd_resp_set_type(req, "text/html");
-    httpd_resp_set_hdr(req, "Content-Encoding", "identity");
-    
-    // 直接返回全局html数组内容
-    httpd_resp_send(req, (const char*)g_web_html, g_web_html_size);
-    
-    return ESP_OK;
+    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+
+    esp_err_t ret = ESP_OK;
+    uint32_t offset = 0;
+    while (offset < hdr.size) {
+        uint32_t len = hdr.size - offset;
+        if (len > WEB_PAGE_CHUNK) {
+            len = WEB_PAGE_CHUNK;
+        }
+        ret = esp_partition_read(part, sizeof(hdr) + offset, chunk, len);
+        if (ret == ESP_OK) {
+            ret = httpd_resp_send_chunk(req, chunk, len);
+        }
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to send page at %u: %s", offset, esp_err_to_name(ret));
+            break;
+        }
+        offset += len;
+    }
+
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
 }
 
 // HTTP POST处理函数 - 处理配置更新
@@ -38,25 +115,19 @@ static esp_err_t post_config_update(httpd_req_t *req)
     
     // 获取POST数据长度
     size_t content_len = req->content_len;
-    if (content_len > 1024) {
+    if (content_len > WEB_POST_MAX) {
         ESP_LOGE(TAG, "POST data too large: %d", content_len);
         httpd_resp_send_500(req);
         return ESP_FAIL;
     }
     
-    // 分配缓冲区
-    char* post_data = malloc(content_len + 1);
-    if (!post_data) {
-        ESP_LOGE(TAG, "Failed to allocate memory for POST data");
-        httpd_resp_send_500(req);
-        return ESP_FAIL;
-    }
+    // 使用配置模式内存区中的缓冲区
+    char* post_data = mem_config()->post;
     
     // 读取POST数据
     int recv_len = httpd_req_recv(req, post_data, content_len);
     if (recv_len <= 0) {
         ESP_LOGE(TAG, "Failed to receive POST data");
-        free(post_data);
         httpd_resp_send_500(req);
         return ESP_FAIL;
     }
@@ -66,7 +137,6 @@ static esp_err_t post_config_update(httpd_req_t *req)
     
     // 处理配置更新
     esp_err_t ret = handle_config_update(post_data, recv_len);
-    free(post_data);
     
     if (ret == ESP_OK) {
         // 返回成功页面
@@ -0,0 +1,544 @@
+#!/usr/bin/env python3
+#
+# Minimal frps stand-in for testing and benchmarking esp_frpc.
+#
+# Speaks the subset of the frp 0.43 protocol the client uses, over a yamux
+# session: Login/LoginResp, the AES-128-CFB IV exchange, NewProxy/
+# NewProxyResp, ReqWorkConn/NewWorkConn/StartWorkConn, Ping/Pong, and yamux
+# DATA/WINDOW_UPDATE/PING/GO_AWAY. Each accepted visitor on the proxy's
+# remote port is paired with a work stream, as frps does.
+#
+# Pure Python, no third party modules. Run standalone to keep a server up:
+#
+#   python3 tools/frps_stub.py --port 7000 --token 52010
+#
+# --http-port stands in for frps's dashboard, which the client probes for an
+# HTTP Date header where NTP is blocked.
+#
+
+import argparse
+import asyncio
+import email.utils
+import hashlib
+import json
+import os
+import struct
+import time
+
+# ---------------------------------------------------------------------------
+# AES-128-CFB (encryption direction only, which is all CFB needs)
+# ---------------------------------------------------------------------------
+
+def _build_sbox():
+    sbox = [0] * 256
+    p = q = 1
+    while True:
+        p = p ^ ((p << 1) & 0xff) ^ (0x1b if p & 0x80 else 0)
+        q ^= q << 1
+        q ^= q << 2
+        q ^= q << 4
+        q &= 0xff
+        if q & 0x80:
+            q ^= 0x09
+        x = q ^ ((q << 1) | (q >> 7)) ^ ((q << 2) | (q >> 6)) ^ ((q << 3) | (q >> 5)) ^ ((q << 4) | (q >> 4))
+        sbox[p] = (x ^ 0x63) & 0xff
+        if p == 1:
+            break
+    sbox[0] = 0x63
+    return sbox
+
+
+_SBOX = _build_sbox()
+
+
+def _xtime(a):
+    return ((a << 1) ^ 0x1b) & 0xff if a & 0x80 else a << 1
+
+
+class AES128:
+    """AES-128 block encryption."""
+
+    def __init__(self, key):
+        assert len(key) == 16
+        w = list(key)
+        rcon = 1
+        for i in range(16, 176, 4):
+            t = w[i - 4:i]
+            if i % 16 == 0:
+                t = [_SBOX[t[1]] ^ rcon, _SBOX[t[2]], _SBOX[t[3]], _SBOX[t[0]]]
+                rcon = _xtime(rcon)
+            w.extend(w[i - 16 + k] ^ t[k] for k in range(4))
+        self._rk = [w[r * 16:(r + 1) * 16] for r in range(11)]
+
+    def encrypt_block(self, block):
+        s = [b ^ k for b, k in zip(block, self._rk[0])]
+        for r in range(1, 11):
+            s = [_SBOX[b] for b in s]
+            s = [s[(i + 4 * (i % 4)) % 16] for i in range(16)]      # ShiftRows
+            if r != 10:
+                m = []
+                for c in range(4):
+                    a = s[4 * c:4 * c + 4]
+                    t = a[0] ^ a[1] ^ a[2] ^ a[3]
+                    m.extend(a[i] ^ t ^ _xtime(a[i] ^ a[(i + 1) % 4]) for i in range(4))
+                s = m
+            s = [b ^ k for b, k in zip(s, self._rk[r])]
+        return bytes(s)
+
+
+class CFBStream:
+    """AES-128-CFB128 over a byte stream, matching Go's cipher.NewCFB*."""
+
+    def __init__(self, key, iv, decrypt):
+        self._aes = AES128(key)
+        self._reg = bytearray(iv)
+        self._ks = b''
+        self._pos = 16
+        self._decrypt = decrypt
+
+    def update(self, data):
+        out = bytearray(len(data))
+        for i, b in enumerate(data):
+            if self._pos == 16:
+                self._ks = self._aes.encrypt_block(self._reg)
+                self._pos = 0
+            o = b ^ self._ks[self._pos]
+            self._reg[self._pos] = b if self._decrypt else o
+            self._pos += 1
+            out[i] = o
+        return bytes(out)
+
+
+def frp_key(token):
+    return hashlib.pbkdf2_hmac('sha1', token.encode(), b'frp', 64, 16)
+
+
+# ---------------------------------------------------------------------------
+# frp messages
+# ---------------------------------------------------------------------------
+
+TypeLogin = b'o'
+TypeLoginResp = b'1'
+TypeNewProxy = b'p'
+TypeNewProxyResp = b'2'
+TypeNewWorkConn = b'w'
+TypeReqWorkConn = b'r'
+TypeStartWorkConn = b's'
+TypePing = b'h'
+TypePong = b'4'
+
+MSG_HDR = struct.Struct('>cQ')
+
+
+def pack_msg(mtype, body):
+    payload = json.dumps(body, separators=(',', ':')).encode()
+    return MSG_HDR.pack(mtype, len(payload)) + payload
+
+
+class MsgParser:
+    """Splits a byte stream into (type, dict) frp messages."""
+
+    def __init__(self):
+        self._buf = b''
+
+    def feed(self, data):
+        self._buf += data
+
+    def next(self):
+        """Pop one complete message, None if more data is needed."""
+        if len(self._buf) < MSG_HDR.size:
+            return None
+        mtype, length = MSG_HDR.unpack_from(self._buf)
+        if len(self._buf) < MSG_HDR.size + length:
+            return None
+        body = self._buf[MSG_HDR.size:MSG_HDR.size + length]
+        self._buf = self._buf[MSG_HDR.size + length:]
+        return mtype, json.loads(body or b'{}')
+
+    def take_rest(self):
+        rest, self._buf = self._buf, b''
+        return rest
+
+
+# ---------------------------------------------------------------------------
+# yamux
+# ---------------------------------------------------------------------------
+
+HDR = struct.Struct('>BBHII')
+DATA, WINDOW_UPDATE, PING, GO_AWAY = range(4)
+SYN, ACK, FIN, RST = 1, 2, 4, 8
+INITIAL_WINDOW = 256 * 1024
+MAX_FRAME = 16 * 1024
+
+
+class Stats:
+    def __init__(self):
+        self.frames_rx = 0
+        self.frames_tx = 0
+        self.bytes_rx = 0
+        self.bytes_tx = 0
+
+    def snapshot(self):
+        return dict(self.__dict__)
+
+
+class Stream:
+    def __init__(self, session, sid):
+        self.session = session
+        self.id = sid
+        self.send_window = INITIAL_WINDOW
+        self.window_event = asyncio.Event()
+        self.window_event.set()
+        self.queue = asyncio.Queue()
+        self.unacked = 0
+        self.closed = False
+
+    async def read(self):
+        """Next chunk of data, b'' once the peer closed the stream."""
+        data = await self.queue.get()
+        if data is None:
+            self.queue.put_nowait(None)
+            return b''
+        self.unacked += len(data)
+        if self.unacked >= INITIAL_WINDOW // 2:
+            self.session.send_frame(WINDOW_UPDATE, 0, self.id, self.unacked)
+            self.unacked = 0
+        return data
+
+    async def write(self, data):
+        while data and not self.closed:
+            if self.send_window == 0:
+                self.window_event.clear()
+                await self.window_event.wait()
+                continue
+            n = min(len(data), self.send_window, MAX_FRAME)
+            self.send_window -= n
+            self.session.send_frame(DATA, 0, self.id, n, data[:n])
+            data = data[n:]
+            await self.session.drain()
+
+    def close(self):
+        if not self.closed:
+            self.closed = True
+            self.session.send_frame(WINDOW_UPDATE, FIN, self.id, 0)
+
+    def remote_closed(self):
+        self.queue.put_nowait(None)
+
+
+class Session:
+    """One client connection: yamux demux plus the frps control logic."""
+
+    def __init__(self, server, reader, writer):
+        self.server = server
+        self.reader = reader
+        self.writer = writer
+        self.streams = {}
+        self.stats = server.stats
+        self.pool = asyncio.Queue()
+        self.ctl = None
+        self.encoder = None
+        self.decoder = None
+        self.client_iv = b''
+        self.logged_in = False
+        self.login_time = 0
+        self.parser = MsgParser()
+        self.proxy = None
+        self.proxy_name = ''
+        self.coalesced = None
+
+    def send_frame(self, ftype, flags, sid, length, payload=b''):
+        self.writer.write(HDR.pack(0, ftype, flags, sid, length) + payload)
+        self.stats.frames_tx += 1
+        self.stats.bytes_tx += len(payload)
+
+    async def drain(self):
+        await self.writer.drain()
+
+    def send_ctl(self, mtype, body):
+        data = pack_msg(mtype, body)
+        if self.encoder:
+            data = self.encoder.update(data)
+        if self.coalesced is not None:
+            self.coalesced += data
+        else:
+            self.send_frame(DATA, 0, 1, len(data), data)
+
+    async def run(self):
+        try:
+            while True:
+                hdr = await self.reader.readexactly(HDR.size)
+                _, ftype, flags, sid, length = HDR.unpack(hdr)
+                payload = b''
+                if ftype == DATA and length:
+                    payload = await self.reader.readexactly(length)
+                self.stats.frames_rx += 1
+                self.stats.bytes_rx += len(payload)
+                await self.on_frame(ftype, flags, sid, length, payload)
+        except (asyncio.IncompleteReadError, ConnectionError):
+            pass
+        finally:
+            for st in self.streams.values():
+                st.closed = True
+                st.remote_closed()
+                st.window_event.set()
+            if self.proxy:
+                self.proxy.close()
+                self.server.proxies.pop(self.proxy_name, None)
+            self.writer.close()
+
+    async def on_frame(self, ftype, flags, sid, length, payload):
+        if ftype == PING:
+            if flags & SYN:
+                self.send_frame(PING, ACK, 0, length)
+            return
+        if ftype == GO_AWAY:
+            raise ConnectionError('go away')
+
+        st = self.streams.get(sid)
+        if flags & SYN and st is None:
+            st = Stream(self, sid)
+            self.streams[sid] = st
+            self.send_frame(WINDOW_UPDATE, ACK, sid, 0)
+            if sid == 1:
+                self.ctl = st
+            else:
+                asyncio.ensure_future(self.work_stream(st))
+        if st is None:
+            return
+
+        if ftype == WINDOW_UPDATE:
+            st.send_window += length
+            st.window_event.set()
+        elif ftype == DATA and payload:
+            if st is self.ctl:
+                self.on_ctl_data(payload)
+            else:
+                st.queue.put_nowait(payload)
+        if flags & (FIN | RST):
+            st.remote_closed()
+            if flags & RST:
+                st.closed = True
+            if st.closed or flags & RST:
+                self.streams.pop(sid, None)
+        await self.drain()
+
+    # -- control stream ----------------------------------------------------
+
+    def on_ctl_data(self, data):
+        if not self.logged_in:
+            self.parser.feed(data)
+            msg = self.parser.next()
+            if msg is None:
+                return
+            self.on_ctl_msg(*msg)
+            data = self.parser.take_rest()   # Anything after Login is the IV exchange
+        if self.decoder is None:
+            # Client's encrypted stream starts with its raw IV
+            need = 16 - len(self.client_iv)
+            self.client_iv += data[:need]
+            data = data[need:]
+            if len(self.client_iv) < 16:
+                return
+            self.decoder = CFBStream(self.server.key, self.client_iv, decrypt=True)
+        self.parser.feed(self.decoder.update(data))
+        while True:
+            msg = self.parser.next()
+            if msg is None:
+                break
+            self.on_ctl_msg(*msg)
+
+    def on_ctl_msg(self, mtype, body):
+        if mtype == TypeLogin and not self.logged_in:
+            ts = body.get('timestamp', 0)
+            want = hashlib.md5((self.server.token + str(ts)).encode()).hexdigest()
+            error = '' if body.get('privilege_key') == want else 'authorization failed'
+            if self.server.coalesce and not error:
+                self.coalesced = b''   # LoginResp, IV and ReqWorkConns in one frame
+            self.send_ctl(TypeLoginResp, {'version': '0.43.0', 'run_id': body.get('run_id', ''),
+                                          'server_udp_port': 0, 'error': error})
+            if error:
+                raise ConnectionError(error)
+            self.logged_in = True
+            self.login_time = time.monotonic()
+            iv = os.urandom(16)
+            if self.coalesced is not None:
+                self.coalesced += iv
+            else:
+                self.send_frame(DATA, 0, 1, 16, iv)
+            self.encoder = CFBStream(self.server.key, iv, decrypt=False)
+            for _ in range(max(1, int(body.get('pool_count', 1)))):
+                self.send_ctl(TypeReqWorkConn, {})
+            if self.coalesced is not None:
+                self.send_frame(DATA, 0, 1, len(self.coalesced), self.coalesced)
+                self.coalesced = None
+        elif mtype == TypeNewProxy:
+            asyncio.ensure_future(self.new_proxy(body))
+        elif mtype == TypePing:
+            self.send_ctl(TypePong, {'error': ''})
+
+    async def new_proxy(self, body):
+        name = body.get('proxy_name', '')
+        port = int(body.get('remote_port', 0))
+        if self.server.remote_port:
+            port = self.server.remote_port
+        try:
+            self.proxy = await asyncio.start_server(self.visitor, self.server.host, port)
+        except OSError as e:
+            self.send_ctl(TypeNewProxyResp, {'proxy_name': name, 'error': str(e)})
+            return
+        self.proxy_name = name
+        self.server.proxies[name] = self
+        port = self.proxy.sockets[0].getsockname()[1]
+        self.send_ctl(TypeNewProxyResp, {'proxy_name': name, 'remote_addr': ':%d' % port, 'error': ''})
+        self.server.on_proxy(name, port, time.monotonic() - self.login_time)
+        await self.drain()
+
+    # -- work connections --------------------------------------------------
+
+    async def work_stream(self, st):
+        parser = MsgParser()
+        msg = None
+        while msg is None:
+            data = await st.read()
+            if not data:
+                return
+            parser.feed(data)
+            msg = parser.next()
+        if msg[0] == TypeNewWorkConn:
+            st.leftover = parser.take_rest()
+            self.pool.put_nowait(st)
+
+    async def get_work_conn(self):
+        while True:
+            try:
+                st = self.pool.get_nowait()
+            except asyncio.QueueEmpty:
+                self.send_ctl(TypeReqWorkConn, {})
+                await self.drain()
+                st = await asyncio.wait_for(self.pool.get(), 10)
+            else:
+                self.send_ctl(TypeReqWorkConn, {})   # Keep the pool topped up
+                await self.drain()
+            if not st.closed:
+                return st
+
+    async def visitor(self, reader, writer):
+        try:
+            st = await self.get_work_conn()
+        except asyncio.TimeoutError:
+            writer.close()
+            return
+        peer = writer.get_extra_info('peername') or ('', 0)
+        await st.write(pack_msg(TypeStartWorkConn, {'proxy_name': self.proxy_name,
+                                                    'src_addr': peer[0], 'src_port': peer[1],
+                                                    'dst_addr': '', 'dst_port': 0, 'error': ''}))
+
+        async def up():
+            while True:
+                data = await reader.read(MAX_FRAME)
+                if not data:
+                    break
+                await st.write(data)
+            st.close()
+
+        async def down():
+            if st.leftover:
+                writer.write(st.leftover)
+            while True:
+                data = await st.read()
+                if not data:
+                    break
+                writer.write(data)
+                await writer.drain()
+            writer.close()
+
+        try:
+            await asyncio.gather(up(), down())
+        except ConnectionError:
+            st.close()
+        finally:
+            writer.close()
+
+
+class FrpsStub:
+    def __init__(self, host='0.0.0.0', port=7000, token='', remote_port=0, coalesce=False):
+        self.host = host
+        self.port = port
+        self.token = token
+        self.coalesce = coalesce
+        self.key = frp_key(token)
+        self.remote_port = remote_port
+        self.stats = Stats()
+        self.proxies = {}
+        self.proxy_ready = asyncio.Event()
+        self.proxy_port = None
+        self.time_to_proxy = None
+        self.sessions = set()
+
+    def on_proxy(self, name, port, elapsed):
+        print('proxy %s registered on port %d, %.1f ms after login' % (name, port, elapsed * 1000), flush=True)
+        self.proxy_port = port
+        self.time_to_proxy = elapsed
+        self.proxy_ready.set()
+
+    async def start(self):
+        async def accept(reader, writer):
+            print('client connected from %s:%d' % writer.get_extra_info('peername')[:2], flush=True)
+            session = Session(self, reader, writer)
+            self.sessions.add(session)
+            await session.run()
+            self.sessions.discard(session)
+            print('client disconnected', flush=True)
+
+        self.server = await asyncio.start_server(accept, self.host, self.port)
+        return self
+
+    async def start_http(self, port, skew=0):
+        """Answer any request on port with a Date header, like frps's dashboard."""
+        async def answer(reader, writer):
+            try:
+                await reader.readuntil(b'\r\n\r\n')
+                date = email.utils.formatdate(time.time() + skew, usegmt=True)
+                writer.write(('HTTP/1.0 200 OK\r\nDate: %s\r\nContent-Length: 0\r\n\r\n' % date).encode())
+                await writer.drain()
+            except (asyncio.IncompleteReadError, asyncio.LimitOverrunError, ConnectionError):
+                pass
+            writer.close()
+
+        self.http = await asyncio.start_server(answer, self.host, port)
+        return self.http
+
+    async def close(self):
+        """Stop listening and drop every client session."""
+        self.server.close()
+        for session in list(self.sessions):
+            session.writer.close()
+        while self.sessions:
+            await asyncio.sleep(0.05)
+
+
+def main():
+    ap = argparse.ArgumentParser(description='frps stand-in for esp_frpc')
+    ap.add_argument('--bind', default='0.0.0.0')
+    ap.add_argument('--port', type=int, default=7000)
+    ap.add_argument('--token', default='52010')
+    ap.add_argument('--remote-port', type=int, default=0, help='override the remote port the client asks for')
+    ap.add_argument('--coalesce', action='store_true', help='send LoginResp, IV and ReqWorkConn in one frame')
+    ap.add_argument('--http-port', type=int, default=0, help='serve HTTP Date probes on this port (frps dashboard stand-in)')
+    ap.add_argument('--http-skew', type=float, default=0, help='seconds added to the served Date')
+    args = ap.parse_args()
+
+    async def serve():
+        stub = await FrpsStub(args.bind, args.port, args.token, args.remote_port, args.coalesce).start()
+        print('frps stub listening on %s:%d' % (args.bind, args.port), flush=True)
+        if args.http_port:
+            await stub.start_http(args.http_port, args.http_skew)
+            print('HTTP Date on %s:%d' % (args.bind, args.http_port), flush=True)
+        await stub.server.serve_forever()
+
+    asyncio.run(serve())
+
+
+if __name__ == '__main__':
+    main()
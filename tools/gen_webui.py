@@ -0,0 +1,57 @@
+#!/usr/bin/env python3
+#
+# Build the web UI partition image for esp_frpc.
+#
+# The config page (web_config.html) is gzip-compressed and written behind a
+# 16-byte header into webui.bin, which goes to the "webui" partition in
+# partitions.csv. In config mode the web server streams it from flash as is,
+# with Content-Encoding: gzip, so the page never has to sit in RAM.
+#
+# Header, little endian, see main/webserver.c:
+#   magic  "WUI1"
+#   size   length of the gzip data that follows
+#   etag   CRC32 of the gzip data, sent as the ETag
+#   check  magic ^ size ^ etag
+#
+# Example:
+#   tools/gen_webui.py web_config.html -o webui.bin
+#
+
+import argparse
+import gzip
+import struct
+import sys
+import zlib
+
+MAGIC = b"WUI1"
+PARTITION_SIZE = 0x4000  # webui entry in partitions.csv
+
+
+def build(html):
+    # mtime=0 keeps the image, and so the ETag, identical for the same page
+    data = gzip.compress(html, compresslevel=9, mtime=0)
+    etag = zlib.crc32(data) & 0xffffffff
+    magic = struct.unpack("<I", MAGIC)[0]
+    header = MAGIC + struct.pack("<III", len(data), etag, magic ^ len(data) ^ etag)
+    return header + data, etag
+
+
+def main():
+    ap = argparse.ArgumentParser(description="build the gzip web UI partition image")
+    ap.add_argument("html", nargs="?", default="web_config.html")
+    ap.add_argument("-o", "--output", default="webui.bin")
+    args = ap.parse_args()
+
+    with open(args.html, "rb") as f:
+        html = f.read()
+    image, etag = build(html)
+    if len(image) > PARTITION_SIZE:
+        sys.exit("%s: %d bytes, does not fit the %d byte webui partition"
+                 % (args.output, len(image), PARTITION_SIZE))
+    with open(args.output, "wb") as f:
+        f.write(image)
+    print("%s: %d -> %d bytes, etag %08x" % (args.output, len(html), len(image), etag))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,199 @@
+#!/usr/bin/env python3
+#
+# End-to-end tunnel benchmark for esp_frpc.
+#
+# Starts the frps stand-in (frps_stub.py), waits for the client (a board, or
+# host/frpc) to log in and register its proxy, then drives visitor
+# connections through the tunnel and writes the results as JSON.
+#
+# Two modes, matching what serves the work connection on the client side:
+#   ack   the on-device handler (LOCAL_PORT 0), which answers every
+#         chunk it gets with "<n> bytes recieved!\n"
+#   echo  a real local service that echoes its input; --echo-port starts one
+#
+# Example, against host/frpc on the same machine:
+#
+#   python3 tools/tunnel_bench.py --port 7000 --token 52010 -o bench.json &
+#   ./host/frpc -s 127.0.0.1 -p 7000 -t 52010 -L 0 -r 7005
+#
+
+import argparse
+import asyncio
+import json
+import re
+import subprocess
+import sys
+import time
+
+from frps_stub import FrpsStub
+
+ACK_RE = re.compile(rb'(\d+) bytes recieved!\n')
+
+
+def percentiles(samples):
+    if not samples:
+        return {'count': 0}
+    s = sorted(samples)
+    pick = lambda p: s[min(len(s) - 1, int((len(s) - 1) * p / 100))]
+    return {'count': len(s), 'p50': round(pick(50), 3), 'p90': round(pick(90), 3),
+            'p99': round(pick(99), 3), 'max': round(s[-1], 3)}
+
+
+class Visitor:
+    """One visitor connection through the proxy's remote port."""
+
+    def __init__(self, mode):
+        self.mode = mode
+        self.buf = b''
+
+    async def connect(self, host, port):
+        self.reader, self.writer = await asyncio.open_connection(host, port)
+
+    async def delivered(self, sent, timeout):
+        """Wait until the client side has taken `sent` bytes in total."""
+        got = 0
+        deadline = time.monotonic() + timeout
+        while got < sent:
+            data = await asyncio.wait_for(self.reader.read(65536), deadline - time.monotonic())
+            if not data:
+                raise ConnectionError('visitor closed after %d/%d bytes' % (got, sent))
+            if self.mode == 'echo':
+                got += len(data)
+                continue
+            self.buf += data
+            while True:
+                m = ACK_RE.search(self.buf)
+                if not m:
+                    break
+                got += int(m.group(1))
+                self.buf = self.buf[m.end():]
+
+    async def round_trip(self, payload, timeout):
+        self.writer.write(payload)
+        await self.writer.drain()
+        await self.delivered(len(payload), timeout)
+
+    def close(self):
+        self.writer.close()
+
+
+async def echo_server(port):
+    async def echo(reader, writer):
+        while True:
+            data = await reader.read(65536)
+            if not data:
+                break
+            writer.write(data)
+            await writer.drain()
+        writer.close()
+
+    return await asyncio.start_server(echo, '0.0.0.0', port)
+
+
+async def bench(args):
+    stub = await FrpsStub(args.bind, args.port, args.token, args.remote_port, args.coalesce).start()
+    try:
+        return await run_bench(stub, args)
+    finally:
+        await stub.close()
+
+
+async def run_bench(stub, args):
+    if args.echo_port:
+        await echo_server(args.echo_port)
+    print('frps stub on %s:%d, waiting for the client...' % (args.bind, args.port), flush=True)
+    await asyncio.wait_for(stub.proxy_ready.wait(), args.wait)
+    host, port = args.visitor_host, stub.proxy_port
+    timeout = args.timeout
+
+    # Connect latency: new visitor to first byte handled by the client
+    connect_ms = []
+    for _ in range(args.connections):
+        v = Visitor(args.mode)
+        t0 = time.monotonic()
+        await v.connect(host, port)
+        await v.round_trip(b'x', timeout)
+        connect_ms.append((time.monotonic() - t0) * 1000)
+        v.close()
+
+    # Round trip latency on an established work connection
+    v = Visitor(args.mode)
+    await v.connect(host, port)
+    await v.round_trip(b'warmup', timeout)
+    rtt_ms = []
+    payload = b'p' * args.rtt_size
+    for _ in range(args.samples):
+        t0 = time.monotonic()
+        await v.round_trip(payload, timeout)
+        rtt_ms.append((time.monotonic() - t0) * 1000)
+
+    # Throughput: stream --bulk bytes, done once the client side took them all
+    chunk = b'd' * args.chunk
+    sent = 0
+    before = stub.stats.snapshot()
+    t0 = time.monotonic()
+    acked = asyncio.ensure_future(v.delivered(args.bulk, timeout + args.bulk / 10000))
+    while sent < args.bulk:
+        n = min(args.chunk, args.bulk - sent)
+        v.writer.write(chunk[:n])
+        await v.writer.drain()
+        sent += n
+    await acked
+    elapsed = time.monotonic() - t0
+    after = stub.stats.snapshot()
+    v.close()
+
+    frames = (after['frames_rx'] - before['frames_rx']) + (after['frames_tx'] - before['frames_tx'])
+    try:
+        commit = subprocess.check_output(['git', 'rev-parse', '--short', 'HEAD'],
+                                         stderr=subprocess.DEVNULL).decode().strip()
+    except (OSError, subprocess.CalledProcessError):
+        commit = ''
+
+    return {
+        'commit': commit,
+        'timestamp': int(time.time()),
+        'mode': args.mode,
+        'config': {'connections': args.connections, 'samples': args.samples,
+                   'rtt_size': args.rtt_size, 'bulk_bytes': args.bulk, 'chunk': args.chunk},
+        'time_to_proxy_ms': round(stub.time_to_proxy * 1000, 3),
+        'connect_ms': percentiles(connect_ms),
+        'rtt_ms': percentiles(rtt_ms),
+        'throughput_MBps': round(args.bulk / elapsed / 1e6, 4),
+        'frames_per_sec': round(frames / elapsed, 1),
+        'frames': {'rx': after['frames_rx'] - before['frames_rx'],
+                   'tx': after['frames_tx'] - before['frames_tx']},
+    }
+
+
+def main():
+    ap = argparse.ArgumentParser(description='esp_frpc tunnel benchmark')
+    ap.add_argument('--bind', default='0.0.0.0')
+    ap.add_argument('--port', type=int, default=7000, help='frps control port')
+    ap.add_argument('--token', default='52010')
+    ap.add_argument('--remote-port', type=int, default=0, help='override the proxy remote port')
+    ap.add_argument('--coalesce', action='store_true', help='stub sends LoginResp, IV and ReqWorkConn in one frame')
+    ap.add_argument('--visitor-host', default='127.0.0.1')
+    ap.add_argument('--mode', choices=('ack', 'echo'), default='ack')
+    ap.add_argument('--echo-port', type=int, default=0, help='start an echo local service on this port')
+    ap.add_argument('--connections', type=int, default=20, help='visitor connects to time')
+    ap.add_argument('--samples', type=int, default=200, help='round trips to time')
+    ap.add_argument('--rtt-size', type=int, default=32)
+    ap.add_argument('--bulk', type=int, default=1 << 20, help='bytes for the throughput run')
+    ap.add_argument('--chunk', type=int, default=1024)
+    ap.add_argument('--wait', type=float, default=120, help='seconds to wait for the client')
+    ap.add_argument('--timeout', type=float, default=10)
+    ap.add_argument('-o', '--output', help='write JSON here instead of stdout')
+    args = ap.parse_args()
+
+    result = asyncio.run(bench(args))
+    text = json.dumps(result, indent=2)
+    if args.output:
+        with open(args.output, 'w') as fp:
+            fp.write(text + '\n')
+    print(text)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())